@@ -1,6 +1,7 @@
 
 #include <iostream>
 #include <vector>
+#include <array>
 #include <string>
 #include <algorithm>
 #include <cmath>
@@ -8,420 +9,7529 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <deque>
+#include <string_view>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <unordered_set>
+#include <variant>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <numeric>
+#include <utility>
+#include <new>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <csignal>
+#include <cerrno>
 using namespace std;
 
+class SymbolTable {
+    // Interns strings that take few distinct values (company names, sales
+    // people, contract statuses) so records store a 32-bit id instead of a
+    // string. Ids never change; resolving an id takes no lock, interning takes
+    // a shared lock on hits and an exclusive one only for new strings.
+    private:
+        static const size_t BLOCK_SIZE = 4096;
+        static const size_t MAX_BLOCKS = 4096;
+
+        mutable shared_mutex lock;
+        unordered_map<string_view, uint32_t> ids;
+        atomic<string*> blocks[MAX_BLOCKS];
+        atomic<uint32_t> count{0};
+
+    public:
+        static const uint32_t NOT_FOUND = 0xFFFFFFFFu;
+
+        SymbolTable() {
+            for (auto& block : blocks) block.store(nullptr, memory_order_relaxed);
+            intern("");
+        }
+
+        SymbolTable(const SymbolTable&) = delete;
+        SymbolTable& operator=(const SymbolTable&) = delete;
+
+        ~SymbolTable() {
+            for (auto& block : blocks) delete[] block.load(memory_order_relaxed);
+        }
+
+        uint32_t intern(string_view text) {
+            {
+                shared_lock<shared_mutex> guard(lock);
+                auto it = ids.find(text);
+                if (it != ids.end()) return it->second;
+            }
+            unique_lock<shared_mutex> guard(lock);
+            auto it = ids.find(text);
+            if (it != ids.end()) return it->second;
+
+            uint32_t id = count.load(memory_order_relaxed);
+            if (id / BLOCK_SIZE >= MAX_BLOCKS) throw length_error("symbol table is full");
+            string* block = blocks[id / BLOCK_SIZE].load(memory_order_relaxed);
+            if (!block) {
+                block = new string[BLOCK_SIZE];
+                blocks[id / BLOCK_SIZE].store(block, memory_order_release);
+            }
+            string& slot = block[id % BLOCK_SIZE];
+            slot.assign(text.data(), text.size());
+            ids.emplace(string_view(slot), id);
+            count.store(id + 1, memory_order_release);
+            return id;
+        }
+
+        // Id of text if it was ever interned, NOT_FOUND otherwise.
+        uint32_t find(string_view text) const {
+            shared_lock<shared_mutex> guard(lock);
+            auto it = ids.find(text);
+            return it == ids.end() ? NOT_FOUND : it->second;
+        }
+
+        string_view name(uint32_t id) const {
+            return blocks[id / BLOCK_SIZE].load(memory_order_acquire)[id % BLOCK_SIZE];
+        }
+
+        size_t size() const { return count.load(memory_order_acquire); }
+};
+
+inline SymbolTable& symbols() {
+    static SymbolTable table;
+    return table;
+}
+
+class TextArena {
+    // Append-only text storage carved out of large blocks. Blocks never move,
+    // so views into them stay valid until clear(); nothing is freed on its
+    // own, the owner decides when to copy what is still live into a new arena.
+    // Blocks are reference counted so that another arena can share them.
+    private:
+        static const size_t BLOCK_SIZE = 1 << 20;
+
+        vector<shared_ptr<char[]>> blocks;
+        size_t used = 0;
+        size_t capacity = 0;
+        size_t bytes = 0;
+
+    public:
+        char* allocate(size_t length) {
+            if (length > capacity - used) {
+                capacity = max(static_cast<size_t>(BLOCK_SIZE), length);
+                blocks.emplace_back(new char[capacity]);
+                used = 0;
+            }
+            char* out = blocks.back().get() + used;
+            used += length;
+            bytes += length;
+            return out;
+        }
+
+        void clear() {
+            blocks.clear();
+            used = capacity = bytes = 0;
+        }
+
+        // Takes a share of every block of other, so text handed out there
+        // stays readable through this arena whatever other does next. Later
+        // allocations here start a block of their own.
+        void share(const TextArena& other) {
+            blocks = other.blocks;
+            used = capacity = 0;
+            bytes = other.bytes;
+        }
+
+        // Bytes handed out so far.
+        size_t size() const { return bytes; }
+        size_t blockCount() const { return blocks.size(); }
+};
+
+// Setters and constructors take strings by value and move them in, so
+// passing a temporary or an std::move()d string copies no text.
 class Person{
 
     protected: string idCard, firstName, lastName, email;
 
     public:
-        void setIdCard(const string& id) { idCard = id; }
-        string getIdCard() const { return idCard; }
+        Person() = default;
+        Person(string id, string fname, string lname, string em)
+            : idCard(move(id)), firstName(move(fname)), lastName(move(lname)), email(move(em)) {}
 
-        void setFirstName(const string& fname) { firstName = fname; }
-        string getFirstName() const { return firstName; }
+        void setIdCard(string id) { idCard = move(id); }
+        const string& getIdCard() const { return idCard; }
 
-        void setLastName(const string& lname) { lastName = lname; }
-        string getLastName() const { return lastName; }
+        void setFirstName(string fname) { firstName = move(fname); }
+        const string& getFirstName() const { return firstName; }
 
-        void setEmail(const string& em) { email = em; }
-        string getEmail() const { return email; }
+        void setLastName(string lname) { lastName = move(lname); }
+        const string& getLastName() const { return lastName; }
+
+        void setEmail(string em) { email = move(em); }
+        const string& getEmail() const { return email; }
 
 };
 
 class Company{
-  private: string name;
+  private: uint32_t nameId = 0;
 
   public:
-    void setName(const string& n) { name = n; }
-    string getName() const { return name; }
+    Company() = default;
+    explicit Company(string_view n) : nameId(symbols().intern(n)) {}
+
+    void setName(string_view n) { nameId = symbols().intern(n); }
+    string_view getName() const { return symbols().name(nameId); }
+    uint32_t getNameId() const { return nameId; }
 };
 
+enum class InteractionKind { Appointment, Contract };
+
+// Interactions are plain values kept in InteractionStore; the kind tag
+// replaces virtual dispatch, so there is no vtable on the hot paths.
 class Interaction {
     protected:
         string description;
-        string type;
+        InteractionKind kind;
+
+        Interaction(string desc, InteractionKind k) : description(move(desc)), kind(k) {}
+
+    public:
+        InteractionKind getKind() const { return kind; }
+
+        void setDescription(string desc) { description = move(desc); }
+        const string& getDescription() const { return description; }
+
+        static const string& typeName(InteractionKind kind) {
+            static const string names[] = {"Appointment", "Contract"};
+            return names[static_cast<int>(kind)];
+        }
+
+        const string& getType() const { return typeName(kind); }
+};
+
+class AppointmentTime {
+    // Start of an appointment as minutes since 1970-01-01 00:00 (proleptic
+    // Gregorian calendar, no time zone), so times compare and subtract as
+    // plain integers.
+    private:
+        int64_t minutes = 0;
+
+        // Day number of a civil date (H. Hinnant's days_from_civil).
+        static int64_t daysFromCivil(int year, int month, int day) {
+            year -= month <= 2;
+            int64_t era = (year >= 0 ? year : year - 399) / 400;
+            int64_t yearOfEra = year - era * 400;
+            int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+            int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+            return era * 146097 + dayOfEra - 719468;
+        }
+
+        static void civilFromDays(int64_t days, int& year, int& month, int& day) {
+            days += 719468;
+            int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+            int64_t dayOfEra = days - era * 146097;
+            int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+            int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+            int64_t mp = (5 * dayOfYear + 2) / 153;
+            day = static_cast<int>(dayOfYear - (153 * mp + 2) / 5 + 1);
+            month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+            year = static_cast<int>(yearOfEra + era * 400 + (month <= 2));
+        }
+
+        static bool parseNumber(string_view text, int& value) {
+            if (text.empty()) return false;
+            auto result = from_chars(text.data(), text.data() + text.size(), value);
+            return result.ec == errc() && result.ptr == text.data() + text.size();
+        }
 
     public:
-        Interaction(const string& desc, const string& t) : description(desc), type(t) {}
-        virtual ~Interaction() = default;
+        static const int64_t MINUTES_PER_DAY = 24 * 60;
+
+        AppointmentTime() = default;
+        explicit AppointmentTime(int64_t minutesSinceEpoch) : minutes(minutesSinceEpoch) {}
+
+        // Day number of a YYYY-MM-DD date, false if it is not a real date.
+        static bool parseDate(string_view date, int64_t& day) {
+            int year, month, dayOfMonth;
+            if (date.size() != 10 || date[4] != '-' || date[7] != '-') return false;
+            if (!parseNumber(date.substr(0, 4), year) || !parseNumber(date.substr(5, 2), month) ||
+                !parseNumber(date.substr(8, 2), dayOfMonth)) {
+                return false;
+            }
+            if (year < 1 || month < 1 || month > 12 || dayOfMonth < 1) return false;
+            static const int monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+            bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+            if (dayOfMonth > monthDays[month - 1] + (month == 2 && leap)) return false;
+            day = daysFromCivil(year, month, dayOfMonth);
+            return true;
+        }
+
+        // Parses "YYYY-MM-DD" and "HH:MM" (or "H:MM"); false if either is invalid.
+        static bool parse(string_view date, string_view hour, AppointmentTime& out) {
+            int64_t day;
+            if (!parseDate(date, day)) return false;
+            size_t colon = hour.find(':');
+            int hours, mins;
+            if (colon == string_view::npos || colon == 0 || colon > 2 || hour.size() != colon + 3) return false;
+            if (!parseNumber(hour.substr(0, colon), hours) || !parseNumber(hour.substr(colon + 1), mins)) return false;
+            if (hours < 0 || hours > 23 || mins < 0 || mins > 59) return false;
+            out.minutes = day * MINUTES_PER_DAY + hours * 60 + mins;
+            return true;
+        }
 
-        void setDescription(const string& desc) { description = desc; }
-        string getDescription() const { return description; }
+        static AppointmentTime startOfDay(int64_t day) { return AppointmentTime(day * MINUTES_PER_DAY); }
 
-        void setType(const string& t) { type = t; }
-        string getType() const { return type; }
+        int64_t getMinutes() const { return minutes; }
 
-        virtual string toString() const = 0;
+        int64_t day() const {
+            return minutes >= 0 ? minutes / MINUTES_PER_DAY : (minutes - MINUTES_PER_DAY + 1) / MINUTES_PER_DAY;
+        }
+
+        // year * 12 + (month - 1)
+        int32_t monthKey() const {
+            int year, month, dayOfMonth;
+            civilFromDays(day(), year, month, dayOfMonth);
+            return year * 12 + (month - 1);
+        }
+
+        string date() const {
+            int year, month, dayOfMonth;
+            civilFromDays(day(), year, month, dayOfMonth);
+            char text[16];
+            snprintf(text, sizeof(text), "%04d-%02d-%02d", year, month, dayOfMonth);
+            return text;
+        }
+
+        string hour() const {
+            int64_t inDay = minutes - day() * MINUTES_PER_DAY;
+            char text[8];
+            snprintf(text, sizeof(text), "%02d:%02d", static_cast<int>(inDay / 60), static_cast<int>(inDay % 60));
+            return text;
+        }
+
+        bool operator<(const AppointmentTime& other) const { return minutes < other.minutes; }
+        bool operator==(const AppointmentTime& other) const { return minutes == other.minutes; }
 };
 
 class Appointment : public Interaction {
     private:
-        string salesPerson;
-        string date;
-        string hour;
+        uint32_t salesPersonId;
+        AppointmentTime time;
 
     public:
-        Appointment(const string& desc, const string& salesperson, const string& dt, const string& hr)
-            : Interaction(desc, "Appointment"), salesPerson(salesperson), date(dt), hour(hr) {}
+        // Appointments are treated as occupying this long for double-booking checks.
+        static const int SLOT_MINUTES = 60;
 
-        void setSalesPerson(const string& sp) { salesPerson = sp; }
-        string getSalesPerson() const { return salesPerson; }
+        Appointment(string desc, string_view salesperson, AppointmentTime when)
+            : Interaction(move(desc), InteractionKind::Appointment), salesPersonId(symbols().intern(salesperson)), time(when) {}
 
-        void setDate(const string& dt) { date = dt; }
-        string getDate() const { return date; }
+        void setSalesPerson(string_view sp) { salesPersonId = symbols().intern(sp); }
+        string_view getSalesPerson() const { return symbols().name(salesPersonId); }
+        uint32_t getSalesPersonId() const { return salesPersonId; }
 
-        void setHour(const string& hr) { hour = hr; }
-        string getHour() const { return hour; }
+        void setTime(AppointmentTime when) { time = when; }
+        AppointmentTime getTime() const { return time; }
 
-        string toString() const override {
-            return "Appointment - " + description + " (Sales: " + salesPerson + ", Date: " + date + ", Hour: " + hour + ")";
+        string getDate() const { return time.date(); }
+        string getHour() const { return time.hour(); }
+
+        string toString() const {
+            return "Appointment - " + description + " (Sales: " + string(getSalesPerson()) + ", Date: " + getDate() + ", Hour: " + getHour() + ")";
         }
 };
 
 class Contract : public Interaction {
     private:
         double value;
-        string status;
+        uint32_t statusId;
 
     public:
-        Contract(const string& desc, double val, const string& stat)
-            : Interaction(desc, "Contract"), value(val), status(stat) {}
+        Contract(string desc, double val, string_view stat)
+            : Interaction(move(desc), InteractionKind::Contract), value(val), statusId(symbols().intern(stat)) {}
 
         void setValue(double val) { value = val; }
         double getValue() const { return value; }
 
-        void setStatus(const string& stat) { status = stat; }
-        string getStatus() const { return status; }
+        void setStatus(string_view stat) { statusId = symbols().intern(stat); }
+        string_view getStatus() const { return symbols().name(statusId); }
+        uint32_t getStatusId() const { return statusId; }
 
-        string toString() const override {
+        string toString() const {
             stringstream ss;
             ss << fixed << setprecision(2) << value;
-            return "Contract - " + description + " (Value: $" + ss.str() + ", Status: " + status + ")";
+            return "Contract - " + description + " (Value: $" + ss.str() + ", Status: " + string(getStatus()) + ")";
         }
 };
 
 class Client : public Person{
 
     private:
-      int policyNumber;
+      int policyNumber = 0;
       Company company;
 
     public:
+      Client() = default;
+      Client(string id, string fname, string lname, string em, int pnum, Company comp)
+          : Person(move(id), move(fname), move(lname), move(em)), policyNumber(pnum), company(comp) {}
+
       void setPolicyNumber(int pnum) { policyNumber = pnum; }
       int getPolicyNumber() const { return policyNumber; }
 
-      void setCompany(const Company& comp) { company = comp; }
-      Company getCompany() const { return company; }
+      void setCompany(Company comp) { company = comp; }
+      const Company& getCompany() const { return company; }
 
 };
 
-class ClientManager {
+class ClientView {
+    // A client's fields as views, into a Client or straight into a file
+    // buffer. This is what ClientManager takes on add and update; it copies
+    // the text into its own storage, so the views only need to outlive the call.
+    private:
+        string_view idCard, firstName, lastName, email;
+        int policyNumber = 0;
+        Company company;
+
+    public:
+        ClientView() = default;
+        ClientView(string_view id, string_view first, string_view last, string_view mail, int policy, Company comp)
+            : idCard(id), firstName(first), lastName(last), email(mail), policyNumber(policy), company(comp) {}
+        ClientView(const Client& client)
+            : idCard(client.getIdCard()), firstName(client.getFirstName()), lastName(client.getLastName()),
+              email(client.getEmail()), policyNumber(client.getPolicyNumber()), company(client.getCompany()) {}
+
+        string_view getIdCard() const { return idCard; }
+        string_view getFirstName() const { return firstName; }
+        string_view getLastName() const { return lastName; }
+        string_view getEmail() const { return email; }
+        int getPolicyNumber() const { return policyNumber; }
+        const Company& getCompany() const { return company; }
+};
+
+class ClientRecord {
+    // A client as ClientManager stores it: the four text fields sit back to
+    // back in the manager's TextArena, so a record is 32 bytes, owns no heap
+    // memory and copying it copies no text.
     private:
-        vector<Client> clients;
-        map<string, vector<Interaction*>> clientInteractions;
+        const char* text = nullptr;
+        uint32_t idLength = 0;
+        uint32_t firstLength = 0;
+        uint32_t lastLength = 0;
+        uint32_t emailLength = 0;
+        int policyNumber = 0;
+        Company company;
+
+    public:
+        ClientRecord() = default;
+
+        ClientRecord(const ClientView& client, TextArena& arena)
+            : idLength(static_cast<uint32_t>(client.getIdCard().size())),
+              firstLength(static_cast<uint32_t>(client.getFirstName().size())),
+              lastLength(static_cast<uint32_t>(client.getLastName().size())),
+              emailLength(static_cast<uint32_t>(client.getEmail().size())),
+              policyNumber(client.getPolicyNumber()), company(client.getCompany()) {
+            char* out = arena.allocate(textSize());
+            text = out;
+            for (string_view field : {client.getIdCard(), client.getFirstName(), client.getLastName(), client.getEmail()}) {
+                memcpy(out, field.data(), field.size());
+                out += field.size();
+            }
+        }
+
+        string_view getIdCard() const { return string_view(text, idLength); }
+        string_view getFirstName() const { return string_view(text + idLength, firstLength); }
+        string_view getLastName() const { return string_view(text + idLength + firstLength, lastLength); }
+        string_view getEmail() const { return string_view(text + idLength + firstLength + lastLength, emailLength); }
+        int getPolicyNumber() const { return policyNumber; }
+        const Company& getCompany() const { return company; }
+
+        size_t textSize() const { return size_t(idLength) + firstLength + lastLength + emailLength; }
+
+        ClientView view() const {
+            return ClientView(getIdCard(), getFirstName(), getLastName(), getEmail(), policyNumber, company);
+        }
+
+        // An owning copy, for callers that edit it or keep it past changes.
+        Client toClient() const {
+            Client client;
+            client.setIdCard(string(getIdCard()));
+            client.setFirstName(string(getFirstName()));
+            client.setLastName(string(getLastName()));
+            client.setEmail(string(getEmail()));
+            client.setPolicyNumber(policyNumber);
+            client.setCompany(company);
+            return client;
+        }
+};
 
+// Key extractors for SlotIndex: each names the field a client is looked up by.
+// Both ClientRecord and ClientView have the same getters.
+struct IdCardKey {
+    template <typename C>
+    static string_view of(const C& client) { return client.getIdCard(); }
+};
+
+struct EmailKey {
+    template <typename C>
+    static string_view of(const C& client) { return client.getEmail(); }
+};
+
+struct PolicyNumberKey {
+    template <typename C>
+    static int of(const C& client) { return client.getPolicyNumber(); }
+};
+
+inline size_t hashKey(string_view key) {
+    size_t h = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+inline size_t hashKey(int key) {
+    uint64_t h = static_cast<uint32_t>(key) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(h ^ (h >> 29));
+}
+
+template <typename KeyOf>
+class SlotIndex {
+    // Open-addressing (linear probing) hash from a client field to its slot.
+    // Only hashes and slots are stored; keys are compared against the client
+    // records themselves. Erased keys leave a tombstone so probe chains stay
+    // intact until the next rehash drops them.
     public:
-        ~ClientManager() {
-            for (auto& pair : clientInteractions) {
-                for (auto* interaction : pair.second) {
-                    delete interaction;
+        using Key = decltype(KeyOf::of(declval<const ClientRecord&>()));
+
+    private:
+        static const int EMPTY = -1;
+        static const int DELETED = -2;
+
+        struct Entry {
+            size_t hash;
+            int slot;
+        };
+
+        vector<Entry> table;
+        size_t used = 0;
+
+        void rehash(size_t capacity) {
+            vector<Entry> old;
+            old.swap(table);
+            table.assign(capacity, Entry{0, EMPTY});
+            used = 0;
+            for (const auto& e : old) {
+                if (e.slot >= 0) {
+                    size_t pos = e.hash & (table.size() - 1);
+                    while (table[pos].slot != EMPTY) pos = (pos + 1) & (table.size() - 1);
+                    table[pos] = e;
+                    used++;
+                }
+            }
+        }
+
+        // Returns the table position holding key, or -1.
+        long long locate(Key key, const vector<ClientRecord>& clients) const {
+            if (table.empty()) return -1;
+            size_t h = hashKey(key);
+            size_t pos = h & (table.size() - 1);
+            while (table[pos].slot != EMPTY) {
+                const Entry& e = table[pos];
+                if (e.slot >= 0 && e.hash == h && KeyOf::of(clients[e.slot]) == key) {
+                    return static_cast<long long>(pos);
                 }
+                pos = (pos + 1) & (table.size() - 1);
             }
+            return -1;
         }
 
-        void addClient(const Client& client) {
-            clients.push_back(client);
+    public:
+        int find(Key key, const vector<ClientRecord>& clients) const {
+            long long pos = locate(key, clients);
+            return pos < 0 ? -1 : table[pos].slot;
         }
 
-        void displayAllClients() const {
-            if (clients.empty()) {
-                cout << "No clients found.\n";
-                return;
+        // The caller guarantees key is not already present.
+        void insert(Key key, int slot) {
+            if ((used + 1) * 10 > table.size() * 7) {
+                size_t capacity = 16;
+                while (capacity * 7 < (used + 1) * 20) capacity <<= 1;
+                rehash(capacity);
+            }
+            size_t h = hashKey(key);
+            size_t pos = h & (table.size() - 1);
+            while (table[pos].slot >= 0) pos = (pos + 1) & (table.size() - 1);
+            if (table[pos].slot == EMPTY) used++;
+            table[pos] = Entry{h, slot};
+        }
+
+        bool erase(Key key, const vector<ClientRecord>& clients) {
+            long long pos = locate(key, clients);
+            if (pos < 0) return false;
+            table[pos].slot = DELETED;
+            return true;
+        }
+
+        void reserve(size_t count) {
+            size_t capacity = 16;
+            while (capacity * 7 < count * 10) capacity <<= 1;
+            if (capacity > table.size()) rehash(capacity);
+        }
+
+        void clear() {
+            table.clear();
+            used = 0;
+        }
+};
+
+using ClientIndex = SlotIndex<IdCardKey>;
+
+// Extension point for looking clients up by something other than their ID
+// card. ClientManager keeps every registered index in step with its slots:
+// erase() is called while the old record is still in place, insert() once
+// the new one is.
+class SecondaryIndex {
+    public:
+        virtual ~SecondaryIndex() = default;
+
+        // Whether client may occupy slot without breaking a uniqueness rule.
+        virtual bool accepts(const ClientView& client, int slot, const vector<ClientRecord>& clients) const = 0;
+        // Human readable form of the key client would be indexed under.
+        virtual string describe(const ClientView& client) const = 0;
+        virtual void insert(const ClientRecord& client, int slot, const vector<ClientRecord>& clients) = 0;
+        virtual void erase(const ClientRecord& client, int slot, const vector<ClientRecord>& clients) = 0;
+        virtual void clear() = 0;
+        // Rebuilds from all live slots in one pass. Returns how many clients
+        // were left out because an earlier slot already owns their key.
+        virtual size_t build(const vector<ClientRecord>& clients, const vector<bool>& live) = 0;
+};
+
+template <typename KeyOf>
+class UniqueIndex : public SecondaryIndex {
+    // At most one client per key. Empty text keys (e.g. no email given)
+    // are not indexed, so any number of clients may leave them blank.
+    private:
+        string label;
+        SlotIndex<KeyOf> table;
+
+        static bool indexed(string_view key) { return !key.empty(); }
+        static bool indexed(int) { return true; }
+
+    public:
+        explicit UniqueIndex(string fieldLabel) : label(move(fieldLabel)) {}
+
+        int find(typename SlotIndex<KeyOf>::Key key, const vector<ClientRecord>& clients) const {
+            if (!indexed(key)) return -1;
+            return table.find(key, clients);
+        }
+
+        bool accepts(const ClientView& client, int slot, const vector<ClientRecord>& clients) const override {
+            int owner = find(KeyOf::of(client), clients);
+            return owner < 0 || owner == slot;
+        }
+
+        string describe(const ClientView& client) const override {
+            ostringstream out;
+            out << label << " " << KeyOf::of(client);
+            return out.str();
+        }
+
+        void insert(const ClientRecord& client, int slot, const vector<ClientRecord>& clients) override {
+            auto key = KeyOf::of(client);
+            if (indexed(key) && table.find(key, clients) < 0) table.insert(key, slot);
+        }
+
+        void erase(const ClientRecord& client, int slot, const vector<ClientRecord>& clients) override {
+            auto key = KeyOf::of(client);
+            if (indexed(key) && table.find(key, clients) == slot) table.erase(key, clients);
+        }
+
+        void clear() override { table.clear(); }
+
+        size_t build(const vector<ClientRecord>& clients, const vector<bool>& live) override {
+            table.clear();
+            table.reserve(clients.size());
+            size_t conflicts = 0;
+            for (size_t i = 0; i < clients.size(); i++) {
+                if (!live[i]) continue;
+                auto key = KeyOf::of(clients[i]);
+                if (!indexed(key)) continue;
+                if (table.find(key, clients) >= 0) conflicts++;
+                else table.insert(key, static_cast<int>(i));
             }
+            return conflicts;
+        }
+};
+
+class CompanyIndex : public SecondaryIndex {
+    // Clients grouped by company. Company names are interned, so the lists
+    // are addressed directly by symbol id and kept in ascending slot order.
+    private:
+        vector<vector<int>> byCompany;
+
+    public:
+        // Live slots of every client of company, in slot order.
+        const vector<int>& find(string_view company) const {
+            static const vector<int> none;
+            uint32_t id = symbols().find(company);
+            if (id == SymbolTable::NOT_FOUND || id >= byCompany.size()) return none;
+            return byCompany[id];
+        }
+
+        bool accepts(const ClientView&, int, const vector<ClientRecord>&) const override { return true; }
+
+        string describe(const ClientView& client) const override {
+            return "company " + string(client.getCompany().getName());
+        }
+
+        void insert(const ClientRecord& client, int slot, const vector<ClientRecord>&) override {
+            uint32_t id = client.getCompany().getNameId();
+            if (id >= byCompany.size()) byCompany.resize(id + 1);
+            auto& slots = byCompany[id];
+            if (slots.empty() || slots.back() < slot) slots.push_back(slot);
+            else slots.insert(lower_bound(slots.begin(), slots.end(), slot), slot);
+        }
+
+        void erase(const ClientRecord& client, int slot, const vector<ClientRecord>&) override {
+            uint32_t id = client.getCompany().getNameId();
+            if (id >= byCompany.size()) return;
+            auto& slots = byCompany[id];
+            auto it = lower_bound(slots.begin(), slots.end(), slot);
+            if (it != slots.end() && *it == slot) slots.erase(it);
+        }
+
+        void clear() override { byCompany.clear(); }
 
-            cout << "\n=== ALL CLIENTS ===\n";
+        size_t build(const vector<ClientRecord>& clients, const vector<bool>& live) override {
+            vector<uint32_t> counts;
+            for (size_t i = 0; i < clients.size(); i++) {
+                if (!live[i]) continue;
+                uint32_t id = clients[i].getCompany().getNameId();
+                if (id >= counts.size()) counts.resize(id + 1, 0);
+                counts[id]++;
+            }
+            byCompany.assign(counts.size(), vector<int>());
+            for (size_t id = 0; id < counts.size(); id++) byCompany[id].reserve(counts[id]);
             for (size_t i = 0; i < clients.size(); i++) {
-                cout << "[" << i + 1 << "] ";
-                cout << "ID: " << clients[i].getIdCard() << " | ";
-                cout << "Name: " << clients[i].getFirstName() << " " << clients[i].getLastName() << " | ";
-                cout << "Email: " << clients[i].getEmail() << " | ";
-                cout << "Policy: " << clients[i].getPolicyNumber() << " | ";
-                cout << "Company: " << clients[i].getCompany().getName() << "\n";
+                if (live[i]) byCompany[clients[i].getCompany().getNameId()].push_back(static_cast<int>(i));
             }
+            return 0;
         }
+};
 
-        bool editClient(int index) {
-            if (index < 0 || index >= static_cast<int>(clients.size())) {
-                cout << "Invalid client index.\n";
-                return false;
+class PostingList {
+    // Slots in ascending order. Slots arriving out of order (an older client
+    // being renamed) land in a small unsorted side list that is merged in
+    // once it reaches an eighth of the main one, so they do not shift a large
+    // list one insert at a time.
+    private:
+        static constexpr size_t MIN_LATE = 64;
+
+        vector<int> slots;
+        vector<int> late;
+
+        static void sortUnique(vector<int>& list) {
+            sort(list.begin(), list.end());
+            list.erase(unique(list.begin(), list.end()), list.end());
+        }
+
+    public:
+        void add(int slot) {
+            if (slots.empty() || slots.back() < slot) {
+                slots.push_back(slot);
+                return;
             }
+            late.push_back(slot);
+            if (late.size() < max(MIN_LATE, slots.size() / 8)) return;
+            size_t middle = slots.size();
+            sortUnique(late);
+            slots.insert(slots.end(), late.begin(), late.end());
+            inplace_merge(slots.begin(), slots.begin() + middle, slots.end());
+            slots.erase(unique(slots.begin(), slots.end()), slots.end());
+            late.clear();
+        }
 
-            Client& client = clients[index];
-            string input;
-            int choice;
+        // The sorted slots; merged into a new entry of scratch if some are late.
+        const vector<int>* sorted(vector<vector<int>>& scratch) const {
+            if (late.empty()) return &slots;
+            vector<int> pending = late;
+            sortUnique(pending);
+            scratch.emplace_back();
+            set_union(slots.begin(), slots.end(), pending.begin(), pending.end(), back_inserter(scratch.back()));
+            return &scratch.back();
+        }
 
-            cout << "\nEditing client: " << client.getFirstName() << " " << client.getLastName() << "\n";
-            cout << "1. Edit ID Card\n2. Edit First Name\n3. Edit Last Name\n";
-            cout << "4. Edit Email\n5. Edit Policy Number\n6. Edit Company Name\n";
-            cout << "Choose field to edit: ";
-            cin >> choice;
-            cin.ignore();
+        size_t size() const { return slots.size() + late.size(); }
+};
 
-            switch (choice) {
-                case 1: {
-                    cout << "Enter new ID Card: ";
-                    getline(cin, input);
-                    client.setIdCard(input);
-                    break;
-                }
-                case 2: {
-                    cout << "Enter new First Name: ";
-                    getline(cin, input);
-                    client.setFirstName(input);
-                    break;
+class NameIndex {
+    // Trigram index over case-folded first and last names, plus "starts
+    // with" grams for the first one and two characters of each name. Posting
+    // lists hold slots in ascending order, so intersections come out in
+    // client order. Entries are never removed: deleted or renamed slots are
+    // filtered out when candidates are verified against the current names.
+    private:
+        unordered_map<uint32_t, PostingList> postings;
+
+        static unsigned char fold(char c) {
+            return static_cast<unsigned char>(tolower(static_cast<unsigned char>(c)));
+        }
+
+        static uint32_t trigram(unsigned char a, unsigned char b, unsigned char c) {
+            return (uint32_t(a) << 16) | (uint32_t(b) << 8) | c;
+        }
+
+        static uint32_t prefixGram(string_view folded) {
+            if (folded.size() == 1) return 0x2000000u | static_cast<unsigned char>(folded[0]);
+            return 0x1000000u | (uint32_t(static_cast<unsigned char>(folded[0])) << 8) | static_cast<unsigned char>(folded[1]);
+        }
+
+        void post(uint32_t gram, int slot) {
+            postings[gram].add(slot);
+        }
+
+        void addName(int slot, string_view name) {
+            string folded = foldCase(name);
+            if (folded.empty()) return;
+            post(prefixGram(string_view(folded).substr(0, 1)), slot);
+            if (folded.size() >= 2) post(prefixGram(string_view(folded).substr(0, 2)), slot);
+            for (size_t i = 0; i + 3 <= folded.size(); i++) {
+                post(trigram(folded[i], folded[i + 1], folded[i + 2]), slot);
+            }
+        }
+
+        // The sorted slots of gram, or nullptr if no name has it.
+        const vector<int>* lookup(uint32_t gram, vector<vector<int>>& scratch) const {
+            auto it = postings.find(gram);
+            return it == postings.end() ? nullptr : it->second.sorted(scratch);
+        }
+
+        // Intersects the posting lists of grams, smallest first.
+        vector<int> intersect(vector<uint32_t> grams) const {
+            vector<const vector<int>*> lists;
+            vector<vector<int>> scratch;
+            scratch.reserve(grams.size());
+            for (uint32_t gram : grams) {
+                const vector<int>* list = lookup(gram, scratch);
+                if (!list) return vector<int>();
+                lists.push_back(list);
+            }
+            sort(lists.begin(), lists.end(), [](const vector<int>* a, const vector<int>* b) { return a->size() < b->size(); });
+            lists.erase(unique(lists.begin(), lists.end()), lists.end());
+
+            vector<int> result = *lists[0];
+            vector<int> next;
+            for (size_t i = 1; i < lists.size() && !result.empty(); i++) {
+                next.clear();
+                set_intersection(result.begin(), result.end(), lists[i]->begin(), lists[i]->end(), back_inserter(next));
+                result.swap(next);
+            }
+            return result;
+        }
+
+        static vector<uint32_t> trigramsOf(string_view folded) {
+            vector<uint32_t> grams;
+            for (size_t i = 0; i + 3 <= folded.size(); i++) {
+                grams.push_back(trigram(folded[i], folded[i + 1], folded[i + 2]));
+            }
+            return grams;
+        }
+
+    public:
+        static string foldCase(string_view text) {
+            string folded(text);
+            for (char& c : folded) c = static_cast<char>(fold(c));
+            return folded;
+        }
+
+        // Case-insensitive substring test against an already folded needle.
+        static bool containsFolded(string_view haystack, string_view needle) {
+            if (needle.size() > haystack.size()) return false;
+            for (size_t i = 0; i + needle.size() <= haystack.size(); i++) {
+                size_t j = 0;
+                while (j < needle.size() && fold(haystack[i + j]) == static_cast<unsigned char>(needle[j])) j++;
+                if (j == needle.size()) return true;
+            }
+            return false;
+        }
+
+        static bool startsWithFolded(string_view text, string_view prefix) {
+            return prefix.size() <= text.size() && containsFolded(text.substr(0, prefix.size()), prefix);
+        }
+
+        // Called for new slots and whenever a slot's names change.
+        void add(int slot, string_view firstName, string_view lastName) {
+            addName(slot, firstName);
+            addName(slot, lastName);
+        }
+
+        void clear() {
+            postings.clear();
+        }
+
+        // Slots whose first or last name contains term, case-insensitively,
+        // in slot order. Terms shorter than a trigram are answered by a scan.
+        vector<int> search(string_view term, const vector<ClientRecord>& clients, const vector<bool>& live) const {
+            string folded = foldCase(term);
+            vector<int> results;
+            auto matches = [&](int slot) {
+                return live[slot] && (containsFolded(clients[slot].getFirstName(), folded) ||
+                                      containsFolded(clients[slot].getLastName(), folded));
+            };
+
+            if (folded.size() < 3) {
+                for (size_t i = 0; i < clients.size(); i++) {
+                    if (matches(static_cast<int>(i))) results.push_back(static_cast<int>(i));
                 }
-                case 3: {
-                    cout << "Enter new Last Name: ";
-                    getline(cin, input);
-                    client.setLastName(input);
-                    break;
+                return results;
+            }
+            for (int slot : intersect(trigramsOf(folded))) {
+                if (matches(slot)) results.push_back(slot);
+            }
+            return results;
+        }
+
+        // Slots whose first or last name starts with prefix, in slot order.
+        vector<int> searchPrefix(string_view prefix, const vector<ClientRecord>& clients, const vector<bool>& live) const {
+            string folded = foldCase(prefix);
+            vector<int> results;
+            if (folded.empty()) return results;
+
+            vector<uint32_t> grams = trigramsOf(folded);
+            grams.push_back(prefixGram(string_view(folded).substr(0, min<size_t>(2, folded.size()))));
+            for (int slot : intersect(grams)) {
+                if (live[slot] && (startsWithFolded(clients[slot].getFirstName(), folded) ||
+                                   startsWithFolded(clients[slot].getLastName(), folded))) {
+                    results.push_back(slot);
                 }
-                case 4: {
-                    cout << "Enter new Email: ";
-                    getline(cin, input);
-                    client.setEmail(input);
-                    break;
+            }
+            return results;
+        }
+};
+
+// Orders a client listing can be paged in. Slot is the order clients were
+// added in, which needs no index.
+enum class ClientOrder { Slot, Name, IdCard, PolicyNumber };
+
+// Whether adding an appointment refuses to double-book its salesperson.
+// Replaying the log passes Unchecked: it restores appointments that were
+// already accepted once.
+enum class Booking { Checked, Unchecked };
+
+class OrderIndex {
+    // Live slots sorted by one ClientOrder, for paging. The bulk is a sorted
+    // array in which removed entries are only marked; a Fenwick tree counts
+    // the entries still valid, so the n-th client is found in O(log^2 n)
+    // without compacting. Additions go to a small sorted side list that is
+    // merged in once it outgrows max(MIN_PENDING, n / 256). Comparisons read
+    // the records themselves, so a slot has to be erased before its record
+    // changes and inserted again afterwards.
+    private:
+        static constexpr size_t MIN_PENDING = 1024;
+
+        ClientOrder order;
+        vector<int> sorted;
+        vector<bool> valid;
+        vector<int> tree;
+        size_t validCount = 0;
+        vector<int> pending;
+
+        static unsigned char fold(char c) {
+            return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c + ('a' - 'A')) : static_cast<unsigned char>(c);
+        }
+
+        // Case-insensitive (ASCII), so "de Luca" sorts next to "De Luca".
+        static int compareFolded(string_view a, string_view b) {
+            size_t length = min(a.size(), b.size());
+            for (size_t i = 0; i < length; i++) {
+                unsigned char x = fold(a[i]), y = fold(b[i]);
+                if (x != y) return x < y ? -1 : 1;
+            }
+            return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+        }
+
+        // The first eight bytes of text, zero-padded and folded for the name
+        // order, as a number that compares like the text.
+        uint64_t prefixKey(string_view text) const {
+            uint64_t key = 0;
+            for (size_t i = 0; i < 8; i++) {
+                unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : 0;
+                key = (key << 8) | (order == ClientOrder::Name ? fold(static_cast<char>(c)) : c);
+            }
+            return key;
+        }
+
+        // The first eight bytes of the sort key as a number: if two keys
+        // differ, so do the clients' places in the order.
+        uint64_t leadingKey(const ClientRecord& client) const {
+            if (order == ClientOrder::PolicyNumber) {
+                return uint64_t(static_cast<uint32_t>(client.getPolicyNumber()) ^ 0x80000000u) << 32;
+            }
+            return prefixKey(order == ClientOrder::Name ? client.getLastName() : client.getIdCard());
+        }
+
+        // Orders most clients with equal leading keys without reading the
+        // records again. ID cards continue with their next eight bytes. Last
+        // names of up to eight bytes with equal keys are equal, so the first
+        // name decides, and they come before the longer names that share the
+        // key, which are left to less(). Like leadingKey(), it only orders
+        // clients where the order does.
+        uint64_t nextKey(const ClientRecord& client) const {
+            if (order == ClientOrder::IdCard) {
+                string_view id = client.getIdCard();
+                return id.size() > 8 ? prefixKey(id.substr(8)) : 0;
+            }
+            if (order != ClientOrder::Name) return 0;
+            if (client.getLastName().size() > 8) return uint64_t(1) << 63;
+            return prefixKey(client.getFirstName()) >> 1;
+        }
+
+        // A strict total order: ties on the key fall back to the ID card,
+        // then the slot.
+        bool less(int a, int b, const vector<ClientRecord>& clients) const {
+            const ClientRecord& x = clients[a];
+            const ClientRecord& y = clients[b];
+            int c = 0;
+            if (order == ClientOrder::Name) {
+                c = compareFolded(x.getLastName(), y.getLastName());
+                if (c == 0) c = compareFolded(x.getFirstName(), y.getFirstName());
+            } else if (order == ClientOrder::PolicyNumber && x.getPolicyNumber() != y.getPolicyNumber()) {
+                c = x.getPolicyNumber() < y.getPolicyNumber() ? -1 : 1;
+            }
+            if (c == 0) c = x.getIdCard().compare(y.getIdCard());
+            return c != 0 ? c < 0 : a < b;
+        }
+
+        // Valid entries among sorted[0, count).
+        size_t validPrefix(size_t count) const {
+            size_t total = 0;
+            for (size_t i = count; i > 0; i -= i & (~i + 1)) total += static_cast<size_t>(tree[i]);
+            return total;
+        }
+
+        void adjust(size_t index, int delta) {
+            for (size_t i = index + 1; i < tree.size(); i += i & (~i + 1)) tree[i] += delta;
+        }
+
+        // Position in sorted of the valid entry with rank (0-based).
+        size_t select(size_t rank) const {
+            size_t position = 0, remaining = rank + 1, step = 1;
+            while (step * 2 < tree.size()) step *= 2;
+            for (; step > 0; step /= 2) {
+                if (position + step < tree.size() && static_cast<size_t>(tree[position + step]) < remaining) {
+                    position += step;
+                    remaining -= static_cast<size_t>(tree[position]);
+                }
+            }
+            return position;
+        }
+
+        // Valid entries of sorted that order before slot.
+        size_t validBefore(int slot, const vector<ClientRecord>& clients) const {
+            size_t low = 0, high = validCount;
+            while (low < high) {
+                size_t middle = (low + high) / 2;
+                if (less(sorted[select(middle)], slot, clients)) low = middle + 1;
+                else high = middle;
+            }
+            return low;
+        }
+
+        // Folds pending into sorted and drops the removed entries. Each
+        // pending slot's place is found by its rank among the valid entries,
+        // so the bulk is copied without comparisons.
+        void merge(const vector<ClientRecord>& clients) {
+            vector<size_t> ranks(pending.size());
+            for (size_t j = 0; j < pending.size(); j++) ranks[j] = validBefore(pending[j], clients);
+            vector<int> merged;
+            merged.reserve(validCount + pending.size());
+            size_t j = 0, copied = 0;
+            for (size_t i = 0; i < sorted.size(); i++) {
+                if (!valid[i]) continue;
+                while (j < pending.size() && ranks[j] == copied) merged.push_back(pending[j++]);
+                merged.push_back(sorted[i]);
+                copied++;
+            }
+            merged.insert(merged.end(), pending.begin() + static_cast<long>(j), pending.end());
+            pending.clear();
+            sorted.swap(merged);
+            valid.assign(sorted.size(), true);
+            validCount = sorted.size();
+            tree.assign(sorted.size() + 1, 0);
+            for (size_t i = 1; i < tree.size(); i++) {
+                tree[i]++;
+                size_t parent = i + (i & (~i + 1));
+                if (parent < tree.size()) tree[parent] += tree[i];
+            }
+        }
+
+    public:
+        OrderIndex(ClientOrder by, const vector<ClientRecord>& clients, const vector<bool>& live) : order(by) {
+            struct Keyed {
+                uint64_t leading, next;
+                int slot;
+            };
+            vector<Keyed> keyed;
+            for (size_t i = 0; i < clients.size(); i++) {
+                if (live[i]) keyed.push_back(Keyed{leadingKey(clients[i]), nextKey(clients[i]), static_cast<int>(i)});
+            }
+            sort(keyed.begin(), keyed.end(), [&](const Keyed& a, const Keyed& b) {
+                if (a.leading != b.leading) return a.leading < b.leading;
+                return a.next != b.next ? a.next < b.next : less(a.slot, b.slot, clients);
+            });
+            pending.reserve(keyed.size());
+            for (const auto& entry : keyed) pending.push_back(entry.slot);
+            merge(clients);
+        }
+
+        void insert(int slot, const vector<ClientRecord>& clients) {
+            auto at = lower_bound(pending.begin(), pending.end(), slot, [&](int a, int b) { return less(a, b, clients); });
+            pending.insert(at, slot);
+            if (pending.size() > max(MIN_PENDING, sorted.size() / 256)) merge(clients);
+        }
+
+        void erase(int slot, const vector<ClientRecord>& clients) {
+            auto at = lower_bound(pending.begin(), pending.end(), slot, [&](int a, int b) { return less(a, b, clients); });
+            if (at != pending.end() && *at == slot) {
+                pending.erase(at);
+                return;
+            }
+            size_t rank = validBefore(slot, clients);
+            if (rank == validCount) return;
+            size_t position = select(rank);
+            if (sorted[position] != slot) return;
+            valid[position] = false;
+            adjust(position, -1);
+            validCount--;
+            if (sorted.size() - validCount > max(MIN_PENDING, validCount)) merge(clients);
+        }
+
+        size_t size() const { return validCount + pending.size(); }
+
+        // Up to limit slots starting at the offset-th client in this order.
+        vector<int> page(size_t offset, size_t limit, const vector<ClientRecord>& clients) const {
+            vector<int> slots;
+            if (offset >= size()) return slots;
+            // The offset clients ahead are some prefix of pending plus the rest from sorted.
+            size_t low = 0, high = pending.size();
+            while (low < high) {
+                size_t middle = (low + high) / 2;
+                if (middle + validBefore(pending[middle], clients) < offset) low = middle + 1;
+                else high = middle;
+            }
+            size_t j = low;
+            size_t i = offset - j < validCount ? select(offset - j) : sorted.size();
+            while (slots.size() < limit) {
+                while (i < sorted.size() && !valid[i]) i++;
+                if (i < sorted.size() && (j == pending.size() || less(sorted[i], pending[j], clients))) {
+                    slots.push_back(sorted[i++]);
+                } else if (j < pending.size()) {
+                    slots.push_back(pending[j++]);
+                } else {
+                    break;
+                }
+            }
+            return slots;
+        }
+};
+
+class FuzzyIndex {
+    // Typo-tolerant lookup by the words of a client's first and last name,
+    // company and email local part: runs of letters, case-folded. Each
+    // distinct word is indexed by its trigrams (padded at both ends) and keeps
+    // the slots using it. A query word is only compared with words sharing
+    // enough trigrams to be within its edit budget (q-gram lemma), then
+    // verified with Myers' bit-parallel edit distance. Every word of a query
+    // has to match. As in NameIndex, slots are never removed from a word;
+    // results are checked against the client's current words.
+    public:
+        struct Match {
+            int slot;
+            double score;
+        };
+
+    private:
+        static const size_t MAX_WORD = 64;
+
+        TextArena wordText;
+        unordered_map<string_view, uint32_t> wordIds;
+        vector<string_view> words;
+        vector<PostingList> slotsOf;
+        unordered_map<uint32_t, vector<uint32_t>> wordsWithGram;
+
+        // Edits allowed for a word of this length.
+        static int budget(size_t length) {
+            return length < 4 ? 0 : length < 8 ? 1 : 2;
+        }
+
+        static bool isLetter(char c) {
+            unsigned char u = static_cast<unsigned char>(c);
+            return isalpha(u) || u >= 0x80;
+        }
+
+        // Calls f with each folded word of text; cut to MAX_WORD bytes.
+        template <typename F>
+        static void forEachWord(string_view text, F&& f) {
+            char word[MAX_WORD];
+            size_t i = 0;
+            while (i < text.size()) {
+                while (i < text.size() && !isLetter(text[i])) i++;
+                size_t length = 0;
+                for (; i < text.size() && isLetter(text[i]); i++) {
+                    if (length < MAX_WORD) word[length++] = static_cast<char>(tolower(static_cast<unsigned char>(text[i])));
+                }
+                if (length > 0) f(string_view(word, length));
+            }
+        }
+
+        template <typename F>
+        static void forEachClientWord(const ClientRecord& client, F&& f) {
+            string_view email = client.getEmail();
+            forEachWord(client.getFirstName(), f);
+            forEachWord(client.getLastName(), f);
+            forEachWord(client.getCompany().getName(), f);
+            forEachWord(email.substr(0, email.find('@')), f);
+        }
+
+        template <typename F>
+        static void forEachGram(string_view word, F&& f) {
+            // \1 and \2 mark the ends, so the first and last letters get grams of their own.
+            uint32_t gram = 0x0101;
+            for (char c : word) {
+                gram = ((gram << 8) | static_cast<unsigned char>(c)) & 0xFFFFFF;
+                f(gram);
+            }
+            for (int i = 0; i < 2; i++) {
+                gram = ((gram << 8) | 0x02) & 0xFFFFFF;
+                f(gram);
+            }
+        }
+
+        // A query word prepared for Myers' algorithm (Hyyro's formulation).
+        class Pattern {
+            private:
+                uint64_t masks[256] = {};
+                size_t length;
+
+            public:
+                explicit Pattern(string_view word) : length(word.size()) {
+                    for (size_t i = 0; i < length; i++) masks[static_cast<unsigned char>(word[i])] |= uint64_t(1) << i;
+                }
+
+                // Levenshtein distance to text.
+                int distance(string_view text) const {
+                    if (length == 0) return static_cast<int>(text.size());
+                    uint64_t positive = ~uint64_t(0), negative = 0, last = uint64_t(1) << (length - 1);
+                    int score = static_cast<int>(length);
+                    for (char c : text) {
+                        uint64_t equal = masks[static_cast<unsigned char>(c)];
+                        uint64_t xv = equal | negative;
+                        uint64_t xh = (((equal & positive) + positive) ^ positive) | equal;
+                        uint64_t up = negative | ~(xh | positive);
+                        uint64_t down = positive & xh;
+                        if (up & last) score++;
+                        else if (down & last) score--;
+                        up = (up << 1) | 1;
+                        down <<= 1;
+                        positive = down | ~(xv | up);
+                        negative = up & xv;
+                    }
+                    return score;
+                }
+        };
+
+        // Indexed words within the edit budget of word, with their similarity
+        // (1 - distance / longer length).
+        vector<pair<uint32_t, double>> similarWords(string_view word) const {
+            vector<pair<uint32_t, double>> found;
+            int edits = budget(word.size());
+            // Padded, word has size() + 2 trigrams and each edit breaks at most three.
+            int needed = static_cast<int>(word.size()) + 2 - 3 * edits;
+            // Counted in an array over all words: a word has at most
+            // MAX_WORD + 2 grams, and the lists of common grams are long.
+            vector<uint8_t> shared(words.size(), 0);
+            vector<uint32_t> touched;
+            forEachGram(word, [&](uint32_t gram) {
+                auto it = wordsWithGram.find(gram);
+                if (it == wordsWithGram.end()) return;
+                for (uint32_t id : it->second) {
+                    if (shared[id]++ == 0) touched.push_back(id);
+                }
+            });
+            Pattern pattern(word);
+            for (uint32_t id : touched) {
+                string_view candidate = words[id];
+                int count = shared[id];
+                if (count < needed || abs(static_cast<int>(candidate.size()) - static_cast<int>(word.size())) > edits) continue;
+                int distance = pattern.distance(candidate);
+                if (distance > edits) continue;
+                found.emplace_back(id, 1.0 - double(distance) / double(max(candidate.size(), word.size())));
+            }
+            sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+                return a.second != b.second ? a.second > b.second : a.first < b.first;
+            });
+            return found;
+        }
+
+        uint32_t idOf(string_view word) const {
+            auto it = wordIds.find(word);
+            return it == wordIds.end() ? UINT32_MAX : it->second;
+        }
+
+        // Raises best[i] to similarity for each candidates[i] that is in
+        // list; both sorted.
+        static void raisePresent(const vector<int>& candidates, const vector<int>& list, double similarity,
+                                 vector<double>& best) {
+            if (candidates.size() * 16 < list.size()) {
+                for (size_t i = 0; i < candidates.size(); i++) {
+                    if (binary_search(list.begin(), list.end(), candidates[i])) best[i] = max(best[i], similarity);
+                }
+                return;
+            }
+            size_t j = 0;
+            for (size_t i = 0; i < candidates.size(); i++) {
+                while (j < list.size() && list[j] < candidates[i]) j++;
+                if (j < list.size() && list[j] == candidates[i]) best[i] = max(best[i], similarity);
+            }
+        }
+
+    public:
+        FuzzyIndex(const vector<ClientRecord>& clients, const vector<bool>& live) {
+            for (size_t i = 0; i < clients.size(); i++) {
+                if (live[i]) add(static_cast<int>(i), clients[i]);
+            }
+        }
+
+        // Called for new slots and whenever a slot's record changes.
+        void add(int slot, const ClientRecord& client) {
+            forEachClientWord(client, [&](string_view word) {
+                uint32_t id = idOf(word);
+                if (id == UINT32_MAX) {
+                    id = static_cast<uint32_t>(words.size());
+                    char* stored = wordText.allocate(word.size());
+                    memcpy(stored, word.data(), word.size());
+                    words.emplace_back(stored, word.size());
+                    wordIds.emplace(words.back(), id);
+                    slotsOf.emplace_back();
+                    forEachGram(word, [&](uint32_t gram) {
+                        vector<uint32_t>& list = wordsWithGram[gram];
+                        if (list.empty() || list.back() != id) list.push_back(id);
+                    });
+                }
+                slotsOf[id].add(slot);
+            });
+        }
+
+        // Up to limit live clients best matching query, best first. A client
+        // scores the average, over the query's words, of its best similarity
+        // to that word (1 is an exact match).
+        vector<Match> search(string_view query, size_t limit, const vector<ClientRecord>& clients,
+                             const vector<bool>& live) const {
+            vector<Match> results;
+            auto better = [](const Match& a, const Match& b) { return a.score != b.score ? a.score > b.score : a.slot < b.slot; };
+            vector<vector<pair<uint32_t, double>>> similar;
+            forEachWord(query, [&](string_view word) { similar.push_back(similarWords(word)); });
+            if (similar.empty() || limit == 0) return results;
+
+            vector<size_t> users(similar.size(), 0), byUsers(similar.size());
+            size_t lists = 0;
+            for (size_t q = 0; q < similar.size(); q++) {
+                for (const auto& match : similar[q]) users[q] += slotsOf[match.first].size();
+                if (users[q] == 0) return results;
+                lists += similar[q].size();
+                byUsers[q] = q;
+            }
+            sort(byUsers.begin(), byUsers.end(), [&](size_t a, size_t b) { return users[a] < users[b]; });
+            vector<unordered_map<uint32_t, double>> bestFor(similar.size());
+            for (size_t q = 0; q < similar.size(); q++) {
+                for (const auto& match : similar[q]) bestFor[q].emplace(match.first, match.second);
+            }
+            vector<vector<int>> scratch;
+            scratch.reserve(lists);
+
+            vector<double> scores(similar.size());
+            auto score = [&](int slot) {
+                fill(scores.begin(), scores.end(), 0.0);
+                forEachClientWord(clients[slot], [&](string_view word) {
+                    uint32_t id = idOf(word);
+                    if (id == UINT32_MAX) return;
+                    for (size_t q = 0; q < similar.size(); q++) {
+                        auto it = bestFor[q].find(id);
+                        if (it != bestFor[q].end()) scores[q] = max(scores[q], it->second);
+                    }
+                });
+                if (*min_element(scores.begin(), scores.end()) == 0) return 0.0;
+                return accumulate(scores.begin(), scores.end(), 0.0) / double(scores.size());
+            };
+
+            if (similar.size() == 1) {
+                // A client scores the similarity of the word it is first found
+                // under, as words are visited best first. The walk stops once
+                // limit clients beat the next word outright, and takes at most
+                // limit clients (the lowest slots) from each word.
+                unordered_set<int> seen;
+                for (const auto& match : similar[0]) {
+                    auto ahead = [&](const Match& m) { return m.score > match.second; };
+                    if (count_if(results.begin(), results.end(), ahead) >= static_cast<long>(limit)) break;
+                    size_t taken = 0;
+                    for (int slot : *slotsOf[match.first].sorted(scratch)) {
+                        if (taken >= limit) break;
+                        if (!live[slot] || !seen.insert(slot).second) continue;
+                        double value = score(slot);
+                        if (value <= 0) continue;
+                        results.push_back(Match{slot, value});
+                        taken++;
+                    }
+                }
+            } else {
+                // Candidates are the clients of the rarest query word's
+                // matches, best match first, narrowed down by each other query
+                // word. A client found under a match of similarity s scores at
+                // most (s + n - 1) / n, so once limit clients reach that the
+                // remaining matches cannot improve the results. While
+                // narrowing, each candidate also gets the similarity of the
+                // best match it is listed under; as lists keep renamed
+                // clients, that bounds its score from above, and only
+                // candidates whose bound beats the current limit-th result
+                // are scored from their words.
+                unordered_set<int> seen;
+                vector<Match> top;
+                // Whether a client scoring at most ceiling could still enter
+                // top. Bounds are summed in another order than score(), so
+                // scores this close count as equal.
+                auto mayEnter = [&](int slot, double ceiling) {
+                    if (top.size() < limit) return true;
+                    const Match& worst = top.front();
+                    if (ceiling > worst.score + 1e-9) return true;
+                    return ceiling >= worst.score - 1e-9 && slot < worst.slot;
+                };
+                double others = double(similar.size() - 1);
+                for (const auto& match : similar[byUsers[0]]) {
+                    double bound = (match.second + others) / double(similar.size());
+                    auto reached = [&](const Match& m) { return m.score >= bound; };
+                    if (count_if(results.begin(), results.end(), reached) >= static_cast<long>(limit)) break;
+                    vector<int> candidates = *slotsOf[match.first].sorted(scratch);
+                    vector<double> bounds(candidates.size(), match.second);
+                    for (size_t k = 1; k < byUsers.size() && !candidates.empty(); k++) {
+                        vector<double> best(candidates.size(), 0.0);
+                        for (const auto& other : similar[byUsers[k]]) {
+                            raisePresent(candidates, *slotsOf[other.first].sorted(scratch), other.second, best);
+                        }
+                        size_t kept = 0;
+                        for (size_t i = 0; i < candidates.size(); i++) {
+                            if (best[i] == 0) continue;
+                            candidates[kept] = candidates[i];
+                            bounds[kept++] = bounds[i] + best[i];
+                        }
+                        candidates.resize(kept);
+                        bounds.resize(kept);
+                    }
+                    // Candidates come in slot order, so once one at the
+                    // match's bound would lose, all the rest would.
+                    for (size_t i = 0; i < candidates.size(); i++) {
+                        int slot = candidates[i];
+                        if (!mayEnter(slot, bound)) break;
+                        if (!mayEnter(slot, bounds[i] / double(similar.size()))) continue;
+                        if (!live[slot] || !seen.insert(slot).second) continue;
+                        double value = score(slot);
+                        if (value <= 0) continue;
+                        results.push_back(Match{slot, value});
+                        top.push_back(results.back());
+                        push_heap(top.begin(), top.end(), better);
+                        if (top.size() > limit) {
+                            pop_heap(top.begin(), top.end(), better);
+                            top.pop_back();
+                        }
+                    }
+                }
+            }
+            size_t keep = min(limit, results.size());
+            partial_sort(results.begin(), results.begin() + static_cast<long>(keep), results.end(), better);
+            results.resize(keep);
+            return results;
+        }
+};
+
+class TimeIndex {
+    // Appointment indices ordered by (start time, index). New entries go to
+    // a small sorted side run that is merged into the main run once it
+    // outgrows about sqrt(n) entries, so inserts cost O(sqrt n) amortised and
+    // range scans O(log n + k). Erased entries are flagged and dropped at the
+    // next merge.
+    public:
+        struct Entry {
+            int64_t time;
+            uint32_t item;
+            uint32_t removed;
+
+            bool operator<(const Entry& other) const {
+                return time != other.time ? time < other.time : item < other.item;
+            }
+        };
+
+    private:
+        static const size_t MIN_RECENT = 256;
+
+        vector<Entry> base;
+        vector<Entry> recent;
+        size_t removedCount = 0;
+
+        void merge() {
+            vector<Entry> merged;
+            merged.reserve(base.size() + recent.size() - removedCount);
+            size_t i = 0, j = 0;
+            while (i < base.size() || j < recent.size()) {
+                const Entry& next = j == recent.size() || (i < base.size() && base[i] < recent[j]) ? base[i++] : recent[j++];
+                if (!next.removed) merged.push_back(next);
+            }
+            base.swap(merged);
+            recent.clear();
+            removedCount = 0;
+        }
+
+        static Entry* locate(vector<Entry>& run, int64_t time, uint32_t item) {
+            Entry key{time, item, 0};
+            for (auto it = lower_bound(run.begin(), run.end(), key); it != run.end() && !(key < *it); ++it) {
+                if (!it->removed) return &*it;
+            }
+            return nullptr;
+        }
+
+    public:
+        void insert(int64_t time, uint32_t item) {
+            Entry entry{time, item, 0};
+            recent.insert(upper_bound(recent.begin(), recent.end(), entry), entry);
+            if (recent.size() > MIN_RECENT && recent.size() * recent.size() > base.size()) merge();
+        }
+
+        bool erase(int64_t time, uint32_t item) {
+            Entry* entry = locate(base, time, item);
+            if (!entry) entry = locate(recent, time, item);
+            if (!entry) return false;
+            entry->removed = 1;
+            removedCount++;
+            if (removedCount > MIN_RECENT && removedCount * 4 > base.size() + recent.size()) merge();
+            return true;
+        }
+
+        // Replaces the contents with entries, sorting them once.
+        void build(vector<Entry> entries) {
+            sort(entries.begin(), entries.end());
+            base.swap(entries);
+            recent.clear();
+            removedCount = 0;
+        }
+
+        void clear() {
+            base.clear();
+            recent.clear();
+            removedCount = 0;
+        }
+
+        size_t size() const { return base.size() + recent.size() - removedCount; }
+
+        // Calls visit(item) for every entry with from <= time < to, in order.
+        template <typename Visit>
+        void scan(int64_t from, int64_t to, Visit visit) const {
+            Entry low{from, 0, 0};
+            auto i = lower_bound(base.begin(), base.end(), low);
+            auto j = lower_bound(recent.begin(), recent.end(), low);
+            while (true) {
+                bool more = i != base.end() && i->time < to;
+                bool moreRecent = j != recent.end() && j->time < to;
+                if (!more && !moreRecent) break;
+                const Entry& next = !moreRecent || (more && *i < *j) ? *i++ : *j++;
+                if (!next.removed) visit(next.item);
+            }
+        }
+};
+
+struct InteractionRef {
+    InteractionKind kind;
+    uint32_t index;
+};
+
+class CodeDictionary {
+    // Maps interned symbol ids to small dense codes, in order of first use,
+    // so per-group tables can be plain arrays. Codes are never reused.
+    private:
+        unordered_map<uint32_t, uint32_t> codes;
+        vector<uint32_t> symbolIds;
+
+    public:
+        // Code of symbol, or SymbolTable::NOT_FOUND if it was never encoded.
+        uint32_t find(uint32_t symbol) const {
+            auto it = codes.find(symbol);
+            return it == codes.end() ? SymbolTable::NOT_FOUND : it->second;
+        }
+
+        uint32_t encode(uint32_t symbol) {
+            auto it = codes.find(symbol);
+            if (it != codes.end()) return it->second;
+            uint32_t code = static_cast<uint32_t>(symbolIds.size());
+            codes.emplace(symbol, code);
+            symbolIds.push_back(symbol);
+            return code;
+        }
+
+        size_t size() const { return symbolIds.size(); }
+        string_view name(uint32_t code) const { return symbols().name(symbolIds[code]); }
+
+        void clear() {
+            codes.clear();
+            symbolIds.clear();
+        }
+};
+
+// Columnar copies of the fields reports aggregate over, parallel to the
+// dense interaction arrays (element i describes contract/appointment i).
+struct ContractColumns {
+    vector<double> value;
+    vector<uint32_t> status;
+    CodeDictionary statuses;
+};
+
+struct AppointmentColumns {
+    vector<uint32_t> salesPerson;
+    vector<int64_t> time;
+    // AppointmentTime::monthKey() of time.
+    vector<int32_t> month;
+    CodeDictionary salesPeople;
+};
+
+template <typename T>
+class CowArray {
+    // An array kept in fixed-size chunks behind shared_ptr, so a copy costs
+    // one pointer per chunk. Copies share chunks until one of them writes to
+    // a chunk, which it then clones first; writes go through mutate(),
+    // push_back() and pop_back(). A copy may be read on another thread while
+    // the original is written.
+    private:
+        static const size_t CHUNK = 1 << 12;
+
+        vector<shared_ptr<vector<T>>> chunks;
+        size_t count = 0;
+
+        // A count of one can only be stale upwards, which merely clones
+        // needlessly; the fence orders our writes after the other owner's
+        // reads, which ended with its release of the chunk.
+        vector<T>& own(size_t chunk) {
+            auto& held = chunks[chunk];
+            if (held.use_count() > 1) held = make_shared<vector<T>>(*held);
+            atomic_thread_fence(memory_order_acquire);
+            return *held;
+        }
+
+    public:
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        const T& operator[](size_t i) const { return (*chunks[i / CHUNK])[i % CHUNK]; }
+        T& mutate(size_t i) { return own(i / CHUNK)[i % CHUNK]; }
+
+        void push_back(T value) {
+            if (count % CHUNK == 0) chunks.push_back(make_shared<vector<T>>());
+            own(count / CHUNK).push_back(move(value));
+            count++;
+        }
+
+        void pop_back() {
+            count--;
+            if (count % CHUNK == 0) chunks.pop_back();
+            else own(count / CHUNK).pop_back();
+        }
+
+        void reserve(size_t n) { chunks.reserve((n + CHUNK - 1) / CHUNK); }
+
+        void clear() {
+            chunks.clear();
+            count = 0;
+        }
+};
+
+class InteractionStore {
+    // Appointments and contracts live in two dense arrays, and each client
+    // slot keeps an ordered list of references into them. Removal moves the
+    // last element into the hole, so scans never meet gaps; every element
+    // remembers its owner slot and list position so the moved element's
+    // reference can be patched. The report columns and time indexes move in
+    // step. Items and lists are copy-on-write, so copyItems() is cheap.
+    private:
+        struct Owner {
+            int slot;
+            uint32_t position;
+        };
+
+        CowArray<Appointment> appointments;
+        CowArray<Contract> contracts;
+        vector<Owner> appointmentOwners;
+        vector<Owner> contractOwners;
+        CowArray<vector<InteractionRef>> byClient;
+        ContractColumns contractColumns;
+        AppointmentColumns appointmentColumns;
+        // Appointments by start time, overall and per salesperson code.
+        TimeIndex byTime;
+        vector<TimeIndex> bySalesPerson;
+        bool timeIndexDeferred = false;
+
+        void indexAppointment(uint32_t index) {
+            int64_t time = appointmentColumns.time[index];
+            uint32_t person = appointmentColumns.salesPerson[index];
+            if (person >= bySalesPerson.size()) bySalesPerson.resize(person + 1);
+            byTime.insert(time, index);
+            bySalesPerson[person].insert(time, index);
+        }
+
+        void unindexAppointment(uint32_t index) {
+            int64_t time = appointmentColumns.time[index];
+            byTime.erase(time, index);
+            bySalesPerson[appointmentColumns.salesPerson[index]].erase(time, index);
+        }
+
+        vector<InteractionRef> collect(const TimeIndex& index, int64_t from, int64_t to) const {
+            vector<InteractionRef> refs;
+            index.scan(from, to, [&](uint32_t item) { refs.push_back({InteractionKind::Appointment, item}); });
+            return refs;
+        }
+
+        const TimeIndex* salesPersonIndex(string_view salesPerson) const {
+            uint32_t symbol = symbols().find(salesPerson);
+            if (symbol == SymbolTable::NOT_FOUND) return nullptr;
+            uint32_t code = appointmentColumns.salesPeople.find(symbol);
+            if (code == SymbolTable::NOT_FOUND || code >= bySalesPerson.size()) return nullptr;
+            return &bySalesPerson[code];
+        }
+
+        template <typename T>
+        static void swapRemove(vector<T>& column, uint32_t index) {
+            column[index] = column.back();
+            column.pop_back();
+        }
+
+        template <typename T>
+        void removeAt(CowArray<T>& items, vector<Owner>& owners, uint32_t index) {
+            uint32_t last = static_cast<uint32_t>(items.size() - 1);
+            if (index != last) {
+                items.mutate(index) = move(items.mutate(last));
+                owners[index] = owners[last];
+                byClient.mutate(owners[index].slot)[owners[index].position].index = index;
+            }
+            items.pop_back();
+            owners.pop_back();
+        }
+
+    public:
+        // Makes room for a new client slot with no interactions.
+        void addSlot() { byClient.push_back({}); }
+
+        void reserveSlots(size_t count) { byClient.reserve(count); }
+
+        // Sizes the dense arrays and their columns for a bulk load, so they
+        // are not regrown (and briefly held twice) on the way.
+        void reserve(size_t appointmentCount, size_t contractCount) {
+            appointments.reserve(appointmentCount);
+            appointmentOwners.reserve(appointmentCount);
+            appointmentColumns.salesPerson.reserve(appointmentCount);
+            appointmentColumns.time.reserve(appointmentCount);
+            appointmentColumns.month.reserve(appointmentCount);
+            contracts.reserve(contractCount);
+            contractOwners.reserve(contractCount);
+            contractColumns.value.reserve(contractCount);
+            contractColumns.status.reserve(contractCount);
+        }
+
+        InteractionRef add(int slot, Appointment appointment) {
+            InteractionRef ref{InteractionKind::Appointment, static_cast<uint32_t>(appointments.size())};
+            appointmentOwners.push_back({slot, static_cast<uint32_t>(byClient[slot].size())});
+            appointmentColumns.salesPerson.push_back(appointmentColumns.salesPeople.encode(appointment.getSalesPersonId()));
+            appointmentColumns.time.push_back(appointment.getTime().getMinutes());
+            appointmentColumns.month.push_back(appointment.getTime().monthKey());
+            appointments.push_back(move(appointment));
+            byClient.mutate(slot).push_back(ref);
+            if (!timeIndexDeferred) indexAppointment(ref.index);
+            return ref;
+        }
+
+        InteractionRef add(int slot, Contract contract) {
+            InteractionRef ref{InteractionKind::Contract, static_cast<uint32_t>(contracts.size())};
+            contractOwners.push_back({slot, static_cast<uint32_t>(byClient[slot].size())});
+            contractColumns.value.push_back(contract.getValue());
+            contractColumns.status.push_back(contractColumns.statuses.encode(contract.getStatusId()));
+            contracts.push_back(move(contract));
+            byClient.mutate(slot).push_back(ref);
+            return ref;
+        }
+
+        void removeClient(int slot) {
+            auto& refs = byClient.mutate(slot);
+            for (size_t i = 0; i < refs.size(); i++) {
+                uint32_t index = refs[i].index;
+                if (refs[i].kind == InteractionKind::Appointment) {
+                    uint32_t last = static_cast<uint32_t>(appointments.size() - 1);
+                    if (!timeIndexDeferred) {
+                        unindexAppointment(index);
+                        if (index != last) {
+                            unindexAppointment(last);
+                            byTime.insert(appointmentColumns.time[last], index);
+                            bySalesPerson[appointmentColumns.salesPerson[last]].insert(appointmentColumns.time[last], index);
+                        }
+                    }
+                    removeAt(appointments, appointmentOwners, index);
+                    swapRemove(appointmentColumns.salesPerson, index);
+                    swapRemove(appointmentColumns.time, index);
+                    swapRemove(appointmentColumns.month, index);
+                } else {
+                    removeAt(contracts, contractOwners, index);
+                    swapRemove(contractColumns.value, index);
+                    swapRemove(contractColumns.status, index);
+                }
+            }
+            vector<InteractionRef>().swap(refs);
+        }
+
+        void clear() {
+            appointments.clear();
+            contracts.clear();
+            appointmentOwners.clear();
+            contractOwners.clear();
+            byClient.clear();
+            contractColumns = ContractColumns();
+            appointmentColumns = AppointmentColumns();
+            byTime.clear();
+            bySalesPerson.clear();
+        }
+
+        // While deferred, added appointments are not put in the time indexes;
+        // buildTimeIndexes() then sorts them all in one go.
+        void deferTimeIndexes() { timeIndexDeferred = true; }
+
+        void buildTimeIndexes() {
+            timeIndexDeferred = false;
+            size_t count = appointmentColumns.time.size();
+            vector<TimeIndex::Entry> all(count);
+            vector<vector<TimeIndex::Entry>> perPerson(appointmentColumns.salesPeople.size());
+            for (uint32_t i = 0; i < count; i++) {
+                TimeIndex::Entry entry{appointmentColumns.time[i], i, 0};
+                all[i] = entry;
+                perPerson[appointmentColumns.salesPerson[i]].push_back(entry);
+            }
+            byTime.build(move(all));
+            bySalesPerson.assign(perPerson.size(), TimeIndex());
+            for (size_t p = 0; p < perPerson.size(); p++) bySalesPerson[p].build(move(perPerson[p]));
+        }
+
+        const vector<InteractionRef>& forClient(int slot) const { return byClient[slot]; }
+
+        // Shares the items and each client's list of them, which is all that
+        // saving reads; owners, report columns and time indexes stay empty.
+        void copyItems(const InteractionStore& other) {
+            appointments = other.appointments;
+            contracts = other.contracts;
+            byClient = other.byClient;
+        }
+
+        // Hands every interaction of slot from over to slot to, after to's
+        // own; only the owner records change, the items stay where they are.
+        void moveClient(int from, int to) {
+            auto& source = byClient.mutate(from);
+            auto& target = byClient.mutate(to);
+            for (const auto& ref : source) {
+                auto& owners = ref.kind == InteractionKind::Appointment ? appointmentOwners : contractOwners;
+                owners[ref.index] = {to, static_cast<uint32_t>(target.size())};
+                target.push_back(ref);
+            }
+            vector<InteractionRef>().swap(source);
+        }
+
+        // Moves the interactions of slot out, in order, leaving their
+        // descriptions empty. Only for a store about to be cleared.
+        vector<variant<Appointment, Contract>> release(int slot) {
+            vector<variant<Appointment, Contract>> items;
+            items.reserve(byClient[slot].size());
+            for (const auto& ref : byClient[slot]) {
+                if (ref.kind == InteractionKind::Appointment) items.emplace_back(move(appointments.mutate(ref.index)));
+                else items.emplace_back(move(contracts.mutate(ref.index)));
+            }
+            return items;
+        }
+
+        const Appointment& appointment(const InteractionRef& ref) const { return appointments[ref.index]; }
+        const Contract& contract(const InteractionRef& ref) const { return contracts[ref.index]; }
+
+        const Interaction& get(const InteractionRef& ref) const {
+            if (ref.kind == InteractionKind::Appointment) return appointments[ref.index];
+            return contracts[ref.index];
+        }
+
+        string toString(const InteractionRef& ref) const {
+            if (ref.kind == InteractionKind::Appointment) return appointments[ref.index].toString();
+            return contracts[ref.index].toString();
+        }
+
+        // Dense arrays for full scans, in no particular order.
+        const CowArray<Appointment>& getAppointments() const { return appointments; }
+        const CowArray<Contract>& getContracts() const { return contracts; }
+
+        const ContractColumns& getContractColumns() const { return contractColumns; }
+        const AppointmentColumns& getAppointmentColumns() const { return appointmentColumns; }
+
+        int ownerSlot(const InteractionRef& ref) const {
+            if (ref.kind == InteractionKind::Appointment) return appointmentOwners[ref.index].slot;
+            return contractOwners[ref.index].slot;
+        }
+
+        // Appointments starting in [from, to), in time order.
+        vector<InteractionRef> appointmentsBetween(AppointmentTime from, AppointmentTime to) const {
+            return collect(byTime, from.getMinutes(), to.getMinutes());
+        }
+
+        vector<InteractionRef> appointmentsBetween(string_view salesPerson, AppointmentTime from, AppointmentTime to) const {
+            const TimeIndex* index = salesPersonIndex(salesPerson);
+            if (!index) return {};
+            return collect(*index, from.getMinutes(), to.getMinutes());
+        }
+
+        // Appointments of salesPerson whose slot would overlap one starting at when.
+        vector<InteractionRef> conflicts(string_view salesPerson, AppointmentTime when) const {
+            const TimeIndex* index = salesPersonIndex(salesPerson);
+            if (!index) return {};
+            int64_t start = when.getMinutes();
+            return collect(*index, start - Appointment::SLOT_MINUTES + 1, start + Appointment::SLOT_MINUTES);
+        }
+};
+
+class Metrics {
+    // Process-wide counters and latency histograms for the hot paths. Each
+    // thread records into its own cache-line-aligned stripe with relaxed
+    // atomics, so recording is two clock reads and a few uncontended
+    // increments; readers add the stripes up in snapshot().
+    public:
+        enum Operation {
+            LoadCsv, SaveCsv, LoadSnapshot, SaveSnapshot, LoadPacked, SavePacked, Search,
+            AddClient, UpdateClient, DeleteClient, AddInteraction, OPERATION_COUNT
+        };
+
+        // Latencies are bucketed by microseconds: exact below 4 us, then four
+        // buckets per power of two (at most 25% wide), up to about 71 minutes.
+        static const size_t BUCKETS = 128;
+
+        struct Totals {
+            uint64_t count[OPERATION_COUNT] = {};
+            uint64_t nanos[OPERATION_COUNT] = {};
+            uint64_t histogram[OPERATION_COUNT][BUCKETS] = {};
+            uint64_t bytesRead = 0;
+            uint64_t bytesWritten = 0;
+            uint64_t allocations = 0;
+
+            double averageMicros(Operation op) const { return count[op] ? nanos[op] / 1000.0 / count[op] : 0.0; }
+
+            // Upper bound of the bucket holding the p-th latency, in microseconds.
+            uint64_t percentileMicros(Operation op, double p) const {
+                if (count[op] == 0) return 0;
+                uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(count[op] - 1)) + 1;
+                uint64_t seen = 0;
+                for (size_t b = 0; b < BUCKETS; b++) {
+                    seen += histogram[op][b];
+                    if (seen >= rank) return bucketLimit(b);
+                }
+                return bucketLimit(BUCKETS - 1);
+            }
+        };
+
+        // Times the enclosing scope.
+        class Timer {
+            private:
+                Operation operation;
+                chrono::steady_clock::time_point start;
+
+            public:
+                explicit Timer(Operation op) : operation(op), start(chrono::steady_clock::now()) {}
+                Timer(const Timer&) = delete;
+                Timer& operator=(const Timer&) = delete;
+                ~Timer() { record(operation, chrono::steady_clock::now() - start); }
+        };
+
+    private:
+        static const size_t STRIPES = 16;
+
+        struct alignas(64) Stripe {
+            atomic<uint64_t> count[OPERATION_COUNT];
+            atomic<uint64_t> nanos[OPERATION_COUNT];
+            atomic<uint64_t> histogram[OPERATION_COUNT][BUCKETS];
+            atomic<uint64_t> bytesRead;
+            atomic<uint64_t> bytesWritten;
+            atomic<uint64_t> allocations;
+        };
+
+        // Zero-initialized static storage, usable before main() and from
+        // operator new.
+        static Stripe stripes[STRIPES];
+        static atomic<unsigned> nextStripe;
+
+        static Stripe& local() {
+            static thread_local int index = -1;
+            if (index < 0) index = static_cast<int>(nextStripe.fetch_add(1, memory_order_relaxed) % STRIPES);
+            return stripes[index];
+        }
+
+        // Atomic adds because a stripe is shared once there are more threads
+        // than stripes.
+        static void bump(atomic<uint64_t>& counter, uint64_t amount) {
+            counter.fetch_add(amount, memory_order_relaxed);
+        }
+
+        static size_t bucketOf(uint64_t micros) {
+            if (micros < 4) return static_cast<size_t>(micros);
+            int log = 0;
+            for (uint64_t rest = micros; rest > 1; rest >>= 1) log++;
+            size_t bucket = static_cast<size_t>(log - 1) * 4 + ((micros >> (log - 2)) & 3);
+            return min(bucket, BUCKETS - 1);
+        }
+
+        static uint64_t bucketLimit(size_t bucket) {
+            if (bucket < 4) return bucket + 1;
+            int log = static_cast<int>(bucket / 4) + 1;
+            return ((4 + bucket % 4) << (log - 2)) + (uint64_t(1) << (log - 2));
+        }
+
+    public:
+        static void record(Operation op, chrono::steady_clock::duration elapsed) {
+            uint64_t nanos = static_cast<uint64_t>(max<int64_t>(0, chrono::duration_cast<chrono::nanoseconds>(elapsed).count()));
+            Stripe& stripe = local();
+            bump(stripe.count[op], 1);
+            bump(stripe.nanos[op], nanos);
+            bump(stripe.histogram[op][bucketOf(nanos / 1000)], 1);
+        }
+
+        static void addBytesRead(uint64_t bytes) { bump(local().bytesRead, bytes); }
+        static void addBytesWritten(uint64_t bytes) { bump(local().bytesWritten, bytes); }
+        static void countAllocation() { bump(local().allocations, 1); }
+
+        static Totals snapshot() {
+            Totals totals;
+            for (const Stripe& stripe : stripes) {
+                for (size_t op = 0; op < OPERATION_COUNT; op++) {
+                    totals.count[op] += stripe.count[op].load(memory_order_relaxed);
+                    totals.nanos[op] += stripe.nanos[op].load(memory_order_relaxed);
+                    for (size_t b = 0; b < BUCKETS; b++) {
+                        totals.histogram[op][b] += stripe.histogram[op][b].load(memory_order_relaxed);
+                    }
+                }
+                totals.bytesRead += stripe.bytesRead.load(memory_order_relaxed);
+                totals.bytesWritten += stripe.bytesWritten.load(memory_order_relaxed);
+                totals.allocations += stripe.allocations.load(memory_order_relaxed);
+            }
+            return totals;
+        }
+
+        static const char* name(Operation op) {
+            static const char* const NAMES[OPERATION_COUNT] = {
+                "load_csv", "save_csv", "load_snapshot", "save_snapshot", "load_packed", "save_packed", "search",
+                "add_client", "update_client", "delete_client", "add_interaction"
+            };
+            return NAMES[op];
+        }
+
+        // One JSON object; latencies in microseconds.
+        static string toJson(const Totals& totals) {
+            stringstream out;
+            out << fixed << setprecision(1) << "{\"bytes_read\":" << totals.bytesRead << ",\"bytes_written\":"
+                << totals.bytesWritten << ",\"allocations\":" << totals.allocations << ",\"operations\":{";
+            for (size_t i = 0; i < OPERATION_COUNT; i++) {
+                Operation op = static_cast<Operation>(i);
+                out << (i ? "," : "") << "\"" << name(op) << "\":{\"count\":" << totals.count[op]
+                    << ",\"total_ms\":" << totals.nanos[op] / 1e6 << ",\"avg_us\":" << totals.averageMicros(op)
+                    << ",\"p50_us\":" << totals.percentileMicros(op, 0.50) << ",\"p99_us\":"
+                    << totals.percentileMicros(op, 0.99) << ",\"max_us\":" << totals.percentileMicros(op, 1.0) << "}";
+            }
+            out << "}}";
+            return out.str();
+        }
+
+        static string toTable(const Totals& totals) {
+            stringstream out;
+            out << fixed << setprecision(1);
+            out << left << setw(16) << "Operation" << right << setw(12) << "Count" << setw(12) << "Total ms"
+                << setw(10) << "Avg us" << setw(10) << "p50 us" << setw(10) << "p99 us" << setw(12) << "Max us" << "\n";
+            for (size_t i = 0; i < OPERATION_COUNT; i++) {
+                Operation op = static_cast<Operation>(i);
+                if (totals.count[op] == 0) continue;
+                out << left << setw(16) << name(op) << right << setw(12) << totals.count[op] << setw(12)
+                    << totals.nanos[op] / 1e6 << setw(10) << totals.averageMicros(op) << setw(10)
+                    << totals.percentileMicros(op, 0.50) << setw(10) << totals.percentileMicros(op, 0.99)
+                    << setw(12) << totals.percentileMicros(op, 1.0) << "\n";
+            }
+            out << setprecision(2) << "Read " << totals.bytesRead / (1024.0 * 1024.0) << " MB, wrote "
+                << totals.bytesWritten / (1024.0 * 1024.0) << " MB, " << totals.allocations << " allocations\n";
+            return out.str();
+        }
+};
+
+Metrics::Stripe Metrics::stripes[Metrics::STRIPES];
+atomic<unsigned> Metrics::nextStripe{0};
+
+// Counts every heap allocation for Metrics. The array and nothrow forms
+// forward to these by default. Not inlined, so the compiler never sees a
+// new expression paired with a bare free().
+[[gnu::noinline]] void* operator new(size_t size) {
+    Metrics::countAllocation();
+    if (void* memory = malloc(size > 0 ? size : 1)) return memory;
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* memory) noexcept { free(memory); }
+[[gnu::noinline]] void operator delete(void* memory, size_t) noexcept { free(memory); }
+
+// Receives every mutation made through ClientManager, e.g. to make it
+// durable. Each call returns the sequence number assigned to the change.
+class ChangeLog {
+    public:
+        virtual ~ChangeLog() = default;
+        virtual uint64_t clientAdded(const ClientView& client) = 0;
+        virtual uint64_t clientUpdated(string_view oldId, const ClientView& client) = 0;
+        virtual uint64_t clientDeleted(string_view clientId) = 0;
+        virtual uint64_t interactionAdded(string_view clientId, const Interaction& interaction) = 0;
+};
+
+class ClientTable {
+    // Formats client rows into one buffer that is written with a single
+    // call, rather than a chain of small writes per field.
+    private:
+        string buffer;
+
+        void number(long long value) {
+            char digits[24];
+            auto result = to_chars(digits, digits + sizeof(digits), value);
+            buffer.append(digits, result.ptr);
+        }
+
+        void slotNumber(int slot) {
+            buffer += '[';
+            number(slot + 1);
+            buffer += "] ";
+        }
+
+    public:
+        void line(string_view text) {
+            buffer.append(text);
+            buffer += '\n';
+        }
+
+        // "[n] ID: ... | Name: ... | Email: ... | Policy: ... | Company: ..."
+        void row(int slot, const ClientRecord& client) {
+            slotNumber(slot);
+            buffer.append("ID: ").append(client.getIdCard());
+            buffer.append(" | Name: ").append(client.getFirstName()).append(" ").append(client.getLastName());
+            buffer.append(" | Email: ").append(client.getEmail());
+            buffer.append(" | Policy: ");
+            number(client.getPolicyNumber());
+            buffer.append(" | Company: ").append(client.getCompany().getName());
+            buffer += '\n';
+        }
+
+        // "[n] Name: ... | Email: ...", followed by extra if there is any.
+        void brief(int slot, const ClientRecord& client, string_view extra = "") {
+            slotNumber(slot);
+            buffer.append("Name: ").append(client.getFirstName()).append(" ").append(client.getLastName());
+            buffer.append(" | Email: ").append(client.getEmail());
+            buffer.append(extra);
+            buffer += '\n';
+        }
+
+        void flush(ostream& out = cout) {
+            out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+            out.flush();
+            buffer.clear();
+        }
+};
+
+class ClientManager {
+    // Clients live in stable slots: deleting one leaves a tombstone instead of
+    // shifting the others, so the numbers shown by the UI stay valid. Their
+    // text is kept in one arena; deleted and replaced records leave theirs
+    // behind until compactText() copies the live records into a fresh one.
+    private:
+        static const size_t MIN_TEXT_GARBAGE = 1 << 20;
+
+        vector<ClientRecord> clients;
+        vector<bool> live;
+        TextArena text;
+        size_t textGarbage = 0;
+        vector<bool> dirty;
+        vector<int> dirtySlots;
+        uint64_t generation = nextGeneration();
+        InteractionStore interactions;
+        ClientIndex idIndex;
+        NameIndex nameIndex;
+        // Kept up to date once built; dropped by bulk loads and built again at
+        // their end if eagerIndexes is set, otherwise on first use.
+        array<unique_ptr<OrderIndex>, 3> orderIndexes;
+        unique_ptr<FuzzyIndex> fuzzyIndex;
+        bool eagerIndexes = false;
+        vector<unique_ptr<SecondaryIndex>> secondaryIndexes;
+        UniqueIndex<EmailKey>* emailIndex = nullptr;
+        UniqueIndex<PolicyNumberKey>* policyIndex = nullptr;
+        CompanyIndex* companyIndex = nullptr;
+        bool bulkLoading = false;
+        size_t liveCount = 0;
+        ChangeLog* changeLog = nullptr;
+        uint64_t logSequence = 0;
+
+        // Reports the first secondary index that would reject client in slot.
+        bool checkUnique(const ClientView& client, int slot) const {
+            for (const auto& index : secondaryIndexes) {
+                if (!index->accepts(client, slot, clients)) {
+                    cout << "Error: a client with " << index->describe(client) << " already exists.\n";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static uint64_t nextGeneration() {
+            static atomic<uint64_t> counter{0};
+            return ++counter;
+        }
+
+        // Bulk loads are not tracked: whoever loads knows what it loaded from.
+        void markDirty(int slot) {
+            if (bulkLoading || dirty[slot]) return;
+            dirty[slot] = true;
+            dirtySlots.push_back(slot);
+        }
+
+        OrderIndex& orderIndex(ClientOrder order) {
+            auto& index = orderIndexes[static_cast<size_t>(order) - 1];
+            if (!index) index = make_unique<OrderIndex>(order, clients, live);
+            return *index;
+        }
+
+        // Runs once garbage makes up half the arena, so the copying is
+        // amortized over at least as many bytes of deletes and edits.
+        void compactText() {
+            if (textGarbage < MIN_TEXT_GARBAGE || textGarbage * 2 < text.size()) return;
+            TextArena fresh;
+            for (size_t i = 0; i < clients.size(); i++) {
+                if (live[i]) clients[i] = ClientRecord(clients[i].view(), fresh);
+            }
+            swap(text, fresh);
+            textGarbage = 0;
+        }
+
+        // Bulk loads restore data as it was saved and skip the booking check;
+        // the time indexes are only complete once they end anyway.
+        template <typename T>
+        bool addInteractionAt(int index, T item, Booking booking = Booking::Checked) {
+            Metrics::Timer timer(Metrics::AddInteraction);
+            if (!isLive(index)) {
+                cout << "Invalid client index.\n";
+                return false;
+            }
+            if constexpr (is_same_v<T, Appointment>) {
+                if (booking == Booking::Checked && !bulkLoading &&
+                    !interactions.conflicts(item.getSalesPerson(), item.getTime()).empty()) {
+                    cout << "Error: " << item.getSalesPerson() << " is already booked at " << item.getDate() << " "
+                         << item.getHour() << ".\n";
+                    return false;
+                }
+            }
+            InteractionRef ref = interactions.add(index, move(item));
+            markDirty(index);
+            if (changeLog) logSequence = changeLog->interactionAdded(clients[index].getIdCard(), interactions.get(ref));
+            return true;
+        }
+
+        template <typename T>
+        bool addInteractionById(const string& clientId, T item, Booking booking = Booking::Checked) {
+            int index = findById(clientId);
+            if (index < 0) {
+                cout << "Client " << clientId << " not found.\n";
+                return false;
+            }
+            return addInteractionAt(index, move(item), booking);
+        }
+
+        // Kept interactions are moved out of the old store rather than copied;
+        // from a non-const list, each new client's strings are freed once stored.
+        template <typename List>
+        void replaceClients(List& newClients) {
+            ChangeLog* log = changeLog;
+            changeLog = nullptr;
+            unordered_map<string, vector<variant<Appointment, Contract>>> kept;
+            kept.reserve(liveCount);
+            for (size_t i = 0; i < clients.size(); i++) {
+                if (!live[i] || interactions.forClient(static_cast<int>(i)).empty()) continue;
+                kept.emplace(string(clients[i].getIdCard()), interactions.release(static_cast<int>(i)));
+            }
+            uint64_t sequence = logSequence;
+            clear();
+            logSequence = sequence;
+
+            reserve(newClients.size());
+            beginBulkLoad();
+            for (auto& client : newClients) {
+                if (findById(client.getIdCard()) >= 0) continue;
+                addClient(client);
+                auto it = kept.find(client.getIdCard());
+                if (it != kept.end()) {
+                    int slot = static_cast<int>(clients.size() - 1);
+                    for (auto& item : it->second) {
+                        visit([&](auto& value) { interactions.add(slot, move(value)); }, item);
+                    }
+                    kept.erase(it);
+                }
+                if constexpr (!is_const_v<List>) client = Client();
+            }
+            endBulkLoad();
+            changeLog = log;
+        }
+
+    public:
+        ClientManager() {
+            emailIndex = addIndex(make_unique<UniqueIndex<EmailKey>>("email"));
+            policyIndex = addIndex(make_unique<UniqueIndex<PolicyNumberKey>>("policy number"));
+            companyIndex = addIndex(make_unique<CompanyIndex>());
+        }
+        ClientManager(const ClientManager&) = delete;
+        ClientManager& operator=(const ClientManager&) = delete;
+
+        bool addClient(const ClientView& client) {
+            Metrics::Timer timer(Metrics::AddClient);
+            if (findById(client.getIdCard()) >= 0) {
+                cout << "Error: a client with ID Card " << client.getIdCard() << " already exists.\n";
+                return false;
+            }
+            int slot = static_cast<int>(clients.size());
+            if (!bulkLoading && !checkUnique(client, slot)) return false;
+            clients.emplace_back(client, text);
+            live.push_back(true);
+            dirty.push_back(false);
+            markDirty(slot);
+            interactions.addSlot();
+            idIndex.insert(client.getIdCard(), slot);
+            if (!bulkLoading) {
+                for (auto& index : secondaryIndexes) index->insert(clients[slot], slot, clients);
+            }
+            nameIndex.add(slot, client.getFirstName(), client.getLastName());
+            for (auto& index : orderIndexes) {
+                if (index) index->insert(slot, clients);
+            }
+            if (fuzzyIndex) fuzzyIndex->add(slot, clients[slot]);
+            liveCount++;
+            if (changeLog) logSequence = changeLog->clientAdded(client);
+            return true;
+        }
+
+        // Replaces the record in slot index, keeping every index in step.
+        bool updateClient(int index, const ClientView& updated) {
+            Metrics::Timer timer(Metrics::UpdateClient);
+            if (!isLive(index)) {
+                cout << "Invalid client index.\n";
+                return false;
+            }
+            ClientRecord& client = clients[index];
+            // Stays valid: the old text is only reclaimed by compactText().
+            string_view oldId = client.getIdCard();
+            if (updated.getIdCard() != oldId && findById(updated.getIdCard()) >= 0) {
+                cout << "Error: a client with ID Card " << updated.getIdCard() << " already exists.\n";
+                return false;
+            }
+            if (!bulkLoading && !checkUnique(updated, index)) return false;
+            if (!bulkLoading) {
+                for (auto& secondary : secondaryIndexes) secondary->erase(client, index, clients);
+            }
+            if (updated.getIdCard() != oldId) {
+                idIndex.erase(oldId, clients);
+                idIndex.insert(updated.getIdCard(), index);
+            }
+            if (updated.getFirstName() != client.getFirstName() || updated.getLastName() != client.getLastName()) {
+                nameIndex.add(index, updated.getFirstName(), updated.getLastName());
+            }
+            for (auto& order : orderIndexes) {
+                if (order) order->erase(index, clients);
+            }
+            textGarbage += client.textSize();
+            client = ClientRecord(updated, text);
+            markDirty(index);
+            if (!bulkLoading) {
+                for (auto& secondary : secondaryIndexes) secondary->insert(client, index, clients);
+            }
+            for (auto& order : orderIndexes) {
+                if (order) order->insert(index, clients);
+            }
+            if (fuzzyIndex) fuzzyIndex->add(index, client);
+            if (changeLog) logSequence = changeLog->clientUpdated(oldId, updated);
+            compactText();
+            return true;
+        }
+
+        // Mutations are reported to log until it is detached with nullptr.
+        // clear() and setClients() are bulk replacements and are not logged.
+        void setChangeLog(ChangeLog* log) { changeLog = log; }
+
+        // Sequence number of the last logged change reflected in this state.
+        uint64_t getLogSequence() const { return logSequence; }
+        void setLogSequence(uint64_t sequence) { logSequence = sequence; }
+
+        int findById(string_view clientId) const {
+            return idIndex.find(clientId, clients);
+        }
+
+        int findByEmail(string_view email) const {
+            return emailIndex->find(email, clients);
+        }
+
+        int findByPolicyNumber(int policyNumber) const {
+            return policyIndex->find(policyNumber, clients);
+        }
+
+        // Slots of every client of company, ascending.
+        const vector<int>& findByCompany(string_view company) const {
+            return companyIndex->find(company);
+        }
+
+        // Registers another index and builds it over the current clients.
+        template <typename T>
+        T* addIndex(unique_ptr<T> index) {
+            T* raw = index.get();
+            index->build(clients, live);
+            secondaryIndexes.push_back(move(index));
+            return raw;
+        }
+
+        // Between these calls addClient() skips the secondary indexes and new
+        // appointments skip the time indexes; both are then built in one pass.
+        // Records that would have been rejected as duplicates are kept and
+        // reported, so existing data is never dropped.
+        void beginBulkLoad() {
+            bulkLoading = true;
+            for (auto& index : orderIndexes) index.reset();
+            fuzzyIndex.reset();
+            interactions.deferTimeIndexes();
+        }
+
+        // With eager indexes the listing orders and the fuzzy index are built
+        // here too, each on a thread of its own next to the other indexes, so
+        // the first sorted page or fuzzy search after a load does not stall.
+        void endBulkLoad(bool quiet = false) {
+            bulkLoading = false;
+            vector<thread> builders;
+            if (eagerIndexes) {
+                for (size_t i = 0; i < orderIndexes.size(); i++) {
+                    builders.emplace_back([this, i]() {
+                        orderIndexes[i] = make_unique<OrderIndex>(static_cast<ClientOrder>(i + 1), clients, live);
+                    });
+                }
+                builders.emplace_back([this]() { fuzzyIndex = make_unique<FuzzyIndex>(clients, live); });
+            }
+            interactions.buildTimeIndexes();
+            for (auto& index : secondaryIndexes) {
+                size_t conflicts = index->build(clients, live);
+                if (conflicts == 0 || quiet) continue;
+                size_t i = 0;
+                while (!live[i] || index->accepts(clients[i].view(), static_cast<int>(i), clients)) i++;
+                cout << "Warning: " << conflicts << " client(s) reuse a key of an earlier client, e.g. "
+                     << index->describe(clients[i].view()) << " (ID Card " << clients[i].getIdCard() << ").\n";
+            }
+            for (auto& builder : builders) builder.join();
+        }
+
+        // For the manager behind the menu or the server: pays for the listing
+        // orders and the fuzzy index at load time rather than at first use.
+        void setEagerIndexes(bool eager) { eagerIndexes = eager; }
+
+        bool isLive(int index) const {
+            return index >= 0 && index < static_cast<int>(clients.size()) && live[index];
+        }
+
+        size_t clientCount() const { return liveCount; }
+
+        // Slots added, edited, deleted or given an interaction since the last
+        // markClean(), each listed once, in no particular order.
+        const vector<int>& getDirtySlots() const { return dirtySlots; }
+
+        void markClean() {
+            for (int slot : dirtySlots) dirty[slot] = false;
+            dirtySlots.clear();
+        }
+
+        // Changes whenever clear() renumbers the slots. Unique across managers
+        // but shared with captures, so equal generations mean equal slots.
+        uint64_t getGeneration() const { return generation; }
+
+        // Copies what saving reads into image, so it can be written on another
+        // thread while this manager carries on: the records, interactions,
+        // log sequence, generation and dirty slots, which this manager then
+        // forgets. The records' text is shared rather than copied and no
+        // index is built, so image is only fit for saving. Dirty slots left in
+        // image by an earlier capture of the same generation are kept, so an
+        // unwritten image can be brought up to date in place.
+        void capture(ClientManager& image) {
+            vector<int> earlier;
+            if (image.generation == generation) earlier.swap(image.dirtySlots);
+            image.clients = clients;
+            image.live = live;
+            image.text.share(text);
+            image.dirty = dirty;
+            image.dirtySlots = dirtySlots;
+            image.generation = generation;
+            image.interactions.copyItems(interactions);
+            image.liveCount = liveCount;
+            image.logSequence = logSequence;
+            for (int slot : earlier) image.markDirty(slot);
+            markClean();
+        }
+
+        // Bulk loads that know their size up front call this first.
+        void reserve(size_t count, size_t appointmentCount = 0, size_t contractCount = 0) {
+            clients.reserve(count);
+            live.reserve(count);
+            dirty.reserve(count);
+            interactions.reserveSlots(count);
+            interactions.reserve(appointmentCount, contractCount);
+            idIndex.reserve(count);
+        }
+
+        void clear() {
+            clients.clear();
+            live.clear();
+            text.clear();
+            textGarbage = 0;
+            dirty.clear();
+            dirtySlots.clear();
+            generation = nextGeneration();
+            interactions.clear();
+            idIndex.clear();
+            nameIndex.clear();
+            for (auto& index : orderIndexes) index.reset();
+            fuzzyIndex.reset();
+            for (auto& index : secondaryIndexes) index->clear();
+            liveCount = 0;
+            logSequence = 0;
+        }
+
+        // Makes replica a copy of this manager that is changed on its own from
+        // then on: the same slots, deleted ones included, interactions and
+        // indexes, so applying the same changes to both keeps them equal.
+        // Text blocks and interaction chunks are shared, not copied; each
+        // side writes to its own from then on.
+        void copyTo(ClientManager& replica) const {
+            replica.clients = clients;
+            replica.live = live;
+            replica.text.share(text);
+            replica.textGarbage = textGarbage;
+            replica.dirty.assign(clients.size(), false);
+            replica.dirtySlots.clear();
+            replica.generation = nextGeneration();
+            replica.interactions = interactions;
+            replica.idIndex = idIndex;
+            replica.nameIndex = nameIndex;
+            for (size_t i = 0; i < orderIndexes.size(); i++) {
+                replica.orderIndexes[i] = orderIndexes[i] ? make_unique<OrderIndex>(*orderIndexes[i]) : nullptr;
+            }
+            replica.fuzzyIndex = fuzzyIndex ? make_unique<FuzzyIndex>(*fuzzyIndex) : nullptr;
+            replica.eagerIndexes = eagerIndexes;
+            for (auto& index : replica.secondaryIndexes) index->build(replica.clients, replica.live);
+            replica.liveCount = liveCount;
+            replica.logSequence = logSequence;
+        }
+
+        // Up to limit live slots starting at the offset-th client in order.
+        // Sorted orders build their index if no load has.
+        vector<int> listClients(ClientOrder order, size_t offset, size_t limit) {
+            if (order != ClientOrder::Slot) return orderIndex(order).page(offset, limit, clients);
+            return as_const(*this).listClients(order, offset, limit);
+        }
+
+        // For readers sharing the manager, which must not change it: an
+        // order no load has indexed is sorted for this page and dropped.
+        vector<int> listClients(ClientOrder order, size_t offset, size_t limit) const {
+            if (order != ClientOrder::Slot) {
+                const auto& index = orderIndexes[static_cast<size_t>(order) - 1];
+                return index ? index->page(offset, limit, clients) : OrderIndex(order, clients, live).page(offset, limit, clients);
+            }
+            vector<int> slots;
+            size_t i = 0;
+            for (size_t skipped = 0; i < clients.size() && skipped < offset; i++) skipped += live[i];
+            for (; i < clients.size() && slots.size() < limit; i++) {
+                if (live[i]) slots.push_back(static_cast<int>(i));
+            }
+            return slots;
+        }
+
+        // Prints up to limit clients starting at the offset-th one in order.
+        void displayAllClients(ClientOrder order = ClientOrder::Slot, size_t offset = 0, size_t limit = SIZE_MAX) {
+            if (liveCount == 0) {
+                cout << "No clients found.\n";
+                return;
+            }
+
+            vector<int> slots = listClients(order, offset, limit);
+            ClientTable table;
+            if (slots.size() == liveCount) {
+                table.line("\n=== ALL CLIENTS ===");
+            } else {
+                static const char* names[] = {"", ", by name", ", by ID card", ", by policy number"};
+                table.line("\n=== ALL CLIENTS (" + to_string(offset + 1) + "-" + to_string(offset + slots.size()) + " of " +
+                           to_string(liveCount) + names[static_cast<int>(order)] + ") ===");
+            }
+            for (int slot : slots) table.row(slot, clients[slot]);
+            table.flush();
+        }
+
+        bool editClient(int index) {
+            if (!isLive(index)) {
+                cout << "Invalid client index.\n";
+                return false;
+            }
+
+            Client client = clients[index].toClient();
+            string input;
+            int choice;
+
+            cout << "\nEditing client: " << client.getFirstName() << " " << client.getLastName() << "\n";
+            cout << "1. Edit ID Card\n2. Edit First Name\n3. Edit Last Name\n";
+            cout << "4. Edit Email\n5. Edit Policy Number\n6. Edit Company Name\n";
+            cout << "Choose field to edit: ";
+            cin >> choice;
+            cin.ignore();
+
+            switch (choice) {
+                case 1: {
+                    cout << "Enter new ID Card: ";
+                    getline(cin, input);
+                    client.setIdCard(input);
+                    break;
+                }
+                case 2: {
+                    cout << "Enter new First Name: ";
+                    getline(cin, input);
+                    client.setFirstName(input);
+                    break;
+                }
+                case 3: {
+                    cout << "Enter new Last Name: ";
+                    getline(cin, input);
+                    client.setLastName(input);
+                    break;
+                }
+                case 4: {
+                    cout << "Enter new Email: ";
+                    getline(cin, input);
+                    client.setEmail(input);
+                    break;
+                }
+                case 5: {
+                    cout << "Enter new Policy Number: ";
+                    cin >> choice;
+                    client.setPolicyNumber(choice);
+                    break;
+                }
+                case 6: {
+                    cout << "Enter new Company Name: ";
+                    getline(cin, input);
+                    Company newCompany;
+                    newCompany.setName(input);
+                    client.setCompany(newCompany);
+                    break;
+                }
+                default:
+                    cout << "Invalid choice.\n";
+                    return false;
+            }
+            if (!updateClient(index, client)) return false;
+            cout << "Client updated successfully!\n";
+            return true;
+        }
+
+        // Deletes without printing; used when replaying logged changes.
+        bool removeClient(int index) {
+            Metrics::Timer timer(Metrics::DeleteClient);
+            if (!isLive(index)) return false;
+
+            if (changeLog) logSequence = changeLog->clientDeleted(clients[index].getIdCard());
+            idIndex.erase(clients[index].getIdCard(), clients);
+            if (!bulkLoading) {
+                for (auto& secondary : secondaryIndexes) secondary->erase(clients[index], index, clients);
+            }
+            for (auto& order : orderIndexes) {
+                if (order) order->erase(index, clients);
+            }
+            interactions.removeClient(index);
+            textGarbage += clients[index].textSize();
+            clients[index] = ClientRecord();
+            live[index] = false;
+            markDirty(index);
+            liveCount--;
+            compactText();
+            return true;
+        }
+
+        // Folds the client in slot duplicate into the one in slot keep: the
+        // duplicate's interactions move over after keep's own, keep takes its
+        // email if it has none, and the duplicate is deleted. Logged as the
+        // equivalent interaction adds, delete and edit, so replay needs no
+        // record type of its own.
+        bool mergeClients(int keep, int duplicate) {
+            if (keep == duplicate || !isLive(keep) || !isLive(duplicate)) return false;
+            if (changeLog) {
+                for (const auto& ref : interactions.forClient(duplicate)) {
+                    logSequence = changeLog->interactionAdded(clients[keep].getIdCard(), interactions.get(ref));
+                }
+            }
+            interactions.moveClient(duplicate, keep);
+            markDirty(keep);
+            string email = clients[keep].getEmail().empty() ? string(clients[duplicate].getEmail()) : string();
+            removeClient(duplicate);
+            if (email.empty()) return true;
+            Client merged = clients[keep].toClient();
+            merged.setEmail(move(email));
+            return updateClient(keep, merged);
+        }
+
+        bool deleteClient(int index) {
+            if (!removeClient(index)) {
+                cout << "Invalid client index.\n";
+                return false;
+            }
+
+            cout << "Client deleted successfully!\n";
+            return true;
+        }
+
+        bool deleteById(const string& clientId) {
+            int index = findById(clientId);
+            if (index < 0) {
+                cout << "Client " << clientId << " not found.\n";
+                return false;
+            }
+            return deleteClient(index);
+        }
+
+        vector<int> searchClients(const string& searchTerm) const {
+            Metrics::Timer timer(Metrics::Search);
+            return nameIndex.search(searchTerm, clients, live);
+        }
+
+        vector<int> searchClientsByPrefix(const string& prefix) const {
+            Metrics::Timer timer(Metrics::Search);
+            return nameIndex.searchPrefix(prefix, clients, live);
+        }
+
+        // Up to limit clients whose name, company or email is close to query,
+        // best first. Builds the fuzzy index if no load has.
+        vector<FuzzyIndex::Match> fuzzySearch(const string& query, size_t limit) {
+            if (!fuzzyIndex) fuzzyIndex = make_unique<FuzzyIndex>(clients, live);
+            return as_const(*this).fuzzySearch(query, limit);
+        }
+
+        // For readers sharing the manager: without a fuzzy index from the
+        // load, one is built for this search and dropped.
+        vector<FuzzyIndex::Match> fuzzySearch(const string& query, size_t limit) const {
+            Metrics::Timer timer(Metrics::Search);
+            if (fuzzyIndex) return fuzzyIndex->search(query, limit, clients, live);
+            return FuzzyIndex(clients, live).search(query, limit, clients, live);
+        }
+
+        // Refuses an appointment that overlaps another of its salesperson's
+        // unless booking is Unchecked or a bulk load is running.
+        bool addInteraction(const string& clientId, Appointment appointment, Booking booking = Booking::Checked) {
+            return addInteractionById(clientId, move(appointment), booking);
+        }
+
+        bool addInteraction(const string& clientId, Contract contract) {
+            return addInteractionById(clientId, move(contract));
+        }
+
+        bool addInteraction(int index, Appointment appointment, Booking booking = Booking::Checked) {
+            return addInteractionAt(index, move(appointment), booking);
+        }
+
+        bool addInteraction(int index, Contract contract) {
+            return addInteractionAt(index, move(contract));
+        }
+
+        void displayClientInteractions(const string& clientId) const {
+            int index = findById(clientId);
+            if (index < 0 || interactions.forClient(index).empty()) {
+                cout << "No interactions found for this client.\n";
+                return;
+            }
+
+            const auto& refs = interactions.forClient(index);
+            cout << "\n=== INTERACTIONS ===\n";
+            for (size_t i = 0; i < refs.size(); i++) {
+                cout << "[" << i + 1 << "] " << interactions.toString(refs[i]) << "\n";
+            }
+        }
+
+        // Indexed by slot; deleted slots hold an empty Client, check isLive().
+        const vector<ClientRecord>& getClients() const { return clients; }
+
+        // Replaces the client list; interactions of IDs that survive are kept.
+        void setClients(const vector<Client>& newClients) { replaceClients(newClients); }
+
+        // As above, but takes the list over and releases each client once it
+        // is stored, so the old and new lists are never both held in full.
+        void setClients(vector<Client>&& newClients) {
+            replaceClients(newClients);
+            vector<Client>().swap(newClients);
+        }
+
+        // Appends items to slot's interactions in order, without copying them.
+        void adoptInteractions(int slot, vector<variant<Appointment, Contract>>&& items) {
+            if (!isLive(slot)) return;
+            for (auto& item : items) {
+                visit([&](auto& value) { addInteractionAt(slot, move(value)); }, item);
+            }
+            items.clear();
+        }
+
+        const vector<InteractionRef>& getInteractions(int index) const { return interactions.forClient(index); }
+        const InteractionStore& getInteractionStore() const { return interactions; }
+};
+
+class Reports {
+    // Pipeline aggregates computed over the store's report columns. Each
+    // kernel is a straight loop over contiguous arrays with independent
+    // accumulators, so the compiler can keep it in vector registers; large
+    // inputs are split into ranges aggregated on separate threads and the
+    // partial results are merged in range order.
+    public:
+        struct Totals {
+            uint64_t count = 0;
+            double sum = 0;
+            double min = 0;
+            double max = 0;
+
+            double average() const { return count ? sum / count : 0; }
+        };
+
+        struct Group {
+            string_view key;
+            uint64_t count;
+            double sum;
+
+            double average() const { return count ? sum / count : 0; }
+        };
+
+        struct MonthlyCount {
+            string_view salesPerson;
+            int year;
+            int month;
+            uint64_t count;
+        };
+
+    private:
+        static const size_t MIN_ROWS_PER_THREAD = 1 << 20;
+        // Largest salesperson x month table aggregated as a flat array.
+        static const size_t MAX_DENSE_CELLS = 1 << 22;
+        static const int LANES = 4;
+
+        // Splits [0, rows) into contiguous ranges and runs kernel(begin, end,
+        // partial) on each, one range per thread.
+        template <typename Partial, typename Kernel>
+        static vector<Partial> runRanges(size_t rows, unsigned threads, const Partial& init, Kernel kernel) {
+            size_t ranges = max<size_t>(1, min<size_t>(threads, rows / MIN_ROWS_PER_THREAD));
+            vector<Partial> partials(ranges, init);
+            size_t step = (rows + ranges - 1) / ranges;
+            vector<thread> workers;
+            for (size_t r = 1; r < ranges; r++) {
+                workers.emplace_back([&, r] { kernel(min(rows, r * step), min(rows, (r + 1) * step), partials[r]); });
+            }
+            kernel(0, min(rows, step), partials[0]);
+            for (auto& worker : workers) worker.join();
+            return partials;
+        }
+
+        static void totalsKernel(const double* values, size_t begin, size_t end, Totals& out) {
+            if (begin == end) return;
+            double sum[LANES] = {0, 0, 0, 0};
+            double low[LANES], high[LANES];
+            for (int l = 0; l < LANES; l++) low[l] = high[l] = values[begin];
+            size_t i = begin;
+            for (; i + LANES <= end; i += LANES) {
+                for (int l = 0; l < LANES; l++) {
+                    double v = values[i + l];
+                    sum[l] += v;
+                    low[l] = v < low[l] ? v : low[l];
+                    high[l] = v > high[l] ? v : high[l];
+                }
+            }
+            for (; i < end; i++) {
+                sum[0] += values[i];
+                low[0] = min(low[0], values[i]);
+                high[0] = max(high[0], values[i]);
+            }
+            out.count = end - begin;
+            out.sum = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+            out.min = min(min(low[0], low[1]), min(low[2], low[3]));
+            out.max = max(max(high[0], high[1]), max(high[2], high[3]));
+        }
+
+        // Group-by sum over small dense codes. Consecutive rows go to separate
+        // accumulator tables so repeated keys do not serialise on one slot.
+        static void groupKernel(const double* values, const uint32_t* codes, size_t groups,
+                                size_t begin, size_t end, vector<double>& sums, vector<uint64_t>& counts) {
+            vector<double> laneSums(LANES * groups, 0.0);
+            vector<uint64_t> laneCounts(LANES * groups, 0);
+            size_t i = begin;
+            for (; i + LANES <= end; i += LANES) {
+                for (int l = 0; l < LANES; l++) {
+                    size_t cell = l * groups + codes[i + l];
+                    laneSums[cell] += values[i + l];
+                    laneCounts[cell]++;
+                }
+            }
+            for (; i < end; i++) {
+                laneSums[codes[i]] += values[i];
+                laneCounts[codes[i]]++;
+            }
+            sums.assign(groups, 0.0);
+            counts.assign(groups, 0);
+            for (int l = 0; l < LANES; l++) {
+                for (size_t g = 0; g < groups; g++) {
+                    sums[g] += laneSums[l * groups + g];
+                    counts[g] += laneCounts[l * groups + g];
+                }
+            }
+        }
+
+    public:
+        static Totals contractTotals(const InteractionStore& store, unsigned threads = 1) {
+            const ContractColumns& columns = store.getContractColumns();
+            auto partials = runRanges(columns.value.size(), threads, Totals(),
+                                      [&](size_t begin, size_t end, Totals& out) {
+                                          totalsKernel(columns.value.data(), begin, end, out);
+                                      });
+            Totals result;
+            for (const auto& part : partials) {
+                if (part.count == 0) continue;
+                result.min = result.count ? min(result.min, part.min) : part.min;
+                result.max = result.count ? max(result.max, part.max) : part.max;
+                result.count += part.count;
+                result.sum += part.sum;
+            }
+            return result;
+        }
+
+        // Count, total and average contract value per status, largest total first.
+        static vector<Group> contractsByStatus(const InteractionStore& store, unsigned threads = 1) {
+            const ContractColumns& columns = store.getContractColumns();
+            size_t groups = columns.statuses.size();
+            using Partial = pair<vector<double>, vector<uint64_t>>;
+            auto partials = runRanges(columns.value.size(), threads, Partial(),
+                                      [&](size_t begin, size_t end, Partial& out) {
+                                          groupKernel(columns.value.data(), columns.status.data(), groups,
+                                                      begin, end, out.first, out.second);
+                                      });
+            vector<Group> result;
+            for (size_t g = 0; g < groups; g++) {
+                Group group{columns.statuses.name(static_cast<uint32_t>(g)), 0, 0.0};
+                for (const auto& part : partials) {
+                    group.sum += part.first[g];
+                    group.count += part.second[g];
+                }
+                if (group.count > 0) result.push_back(group);
+            }
+            sort(result.begin(), result.end(), [](const Group& a, const Group& b) {
+                if (a.sum != b.sum) return a.sum > b.sum;
+                return a.key < b.key;
+            });
+            return result;
+        }
+
+        // Appointments per salesperson per calendar month, ordered by
+        // salesperson then month.
+        static vector<MonthlyCount> appointmentsBySalesPersonMonth(const InteractionStore& store, unsigned threads = 1) {
+            const AppointmentColumns& columns = store.getAppointmentColumns();
+            size_t rows = columns.month.size();
+            const int32_t* months = columns.month.data();
+            const uint32_t* people = columns.salesPerson.data();
+
+            vector<MonthlyCount> result;
+            if (rows == 0) return result;
+            int32_t first = months[0], last = months[0];
+            for (size_t i = 1; i < rows; i++) {
+                first = min(first, months[i]);
+                last = max(last, months[i]);
+            }
+
+            size_t span = static_cast<size_t>(last - first) + 1;
+            size_t cells = span * columns.salesPeople.size();
+            map<uint64_t, uint64_t> sparse;
+            vector<uint64_t> dense;
+            if (cells <= MAX_DENSE_CELLS) {
+                auto partials = runRanges(rows, threads, vector<uint64_t>(cells, 0),
+                                          [&](size_t begin, size_t end, vector<uint64_t>& out) {
+                                              for (size_t i = begin; i < end; i++) {
+                                                  out[people[i] * span + (months[i] - first)]++;
+                                              }
+                                          });
+                dense.assign(cells, 0);
+                for (const auto& part : partials) {
+                    for (size_t c = 0; c < cells; c++) dense[c] += part[c];
+                }
+            } else {
+                for (size_t i = 0; i < rows; i++) {
+                    sparse[static_cast<uint64_t>(people[i]) * span + (months[i] - first)]++;
+                }
+            }
+
+            auto emit = [&](uint64_t cell, uint64_t count) {
+                int32_t month = first + static_cast<int32_t>(cell % span);
+                result.push_back({columns.salesPeople.name(static_cast<uint32_t>(cell / span)), month / 12, month % 12 + 1, count});
+            };
+            for (size_t c = 0; c < dense.size(); c++) {
+                if (dense[c] > 0) emit(c, dense[c]);
+            }
+            for (const auto& [cell, count] : sparse) emit(cell, count);
+            stable_sort(result.begin(), result.end(), [](const MonthlyCount& a, const MonthlyCount& b) {
+                return a.salesPerson < b.salesPerson;
+            });
+            return result;
+        }
+};
+
+class ConcurrentClientManager {
+    // Thread-safe front for ClientManager using the left-right technique:
+    // two identical replicas, one published to readers. A reader pins the
+    // published replica with a striped counter and then works on it without
+    // locks; that replica never changes while pinned. The single writer
+    // applies a change to the unpublished replica, publishes it, waits for
+    // readers still pinning the old one to leave, then replays the change
+    // there. Only changes that succeeded are replayed, so error messages
+    // appear once, and only the first application reaches the change log.
+    // It owns both replicas, or wraps a ClientManager its owner keeps (e.g.
+    // to save it) and keeps a copy of it as the other.
+    public:
+        using Operation = function<bool(ClientManager&)>;
+
+    private:
+        static const size_t STRIPES = 16;
+
+        struct alignas(64) ReaderCount {
+            atomic<long> value{0};
+        };
+
+        unique_ptr<ClientManager> owned[2];
+        ClientManager* replicas[2];
+        mutable ReaderCount readers[2][STRIPES];
+        atomic<int> published{0};
+        atomic<uint64_t> version{0};
+        mutex writeLock;
+        ChangeLog* changeLog = nullptr;
+
+        static size_t stripe() {
+            static thread_local size_t index = hash<thread::id>()(this_thread::get_id()) % STRIPES;
+            return index;
+        }
+
+        void waitForReaders(int side) const {
+            for (size_t s = 0; s < STRIPES; s++) {
+                while (readers[side][s].value.load() != 0) this_thread::yield();
+            }
+        }
+
+        // Applies ops to the hidden replica, publishes it and brings the other
+        // replica up to date. Returns which ops succeeded. Caller holds writeLock.
+        vector<bool> apply(const vector<Operation>& ops) {
+            int side = published.load();
+            ClientManager& next = *replicas[1 - side];
+            ClientManager& previous = *replicas[side];
+
+            vector<bool> succeeded(ops.size());
+            next.setChangeLog(changeLog);
+            for (size_t i = 0; i < ops.size(); i++) succeeded[i] = ops[i](next);
+            next.setChangeLog(nullptr);
+
+            published.store(1 - side);
+            version++;
+            waitForReaders(side);
+
+            for (size_t i = 0; i < ops.size(); i++) {
+                if (succeeded[i]) ops[i](previous);
+            }
+            previous.setLogSequence(next.getLogSequence());
+            return succeeded;
+        }
+
+        class Pin {
+            private:
+                const ConcurrentClientManager& owner;
+                size_t slot;
+                int side;
+
+            public:
+                explicit Pin(const ConcurrentClientManager& mgr) : owner(mgr), slot(stripe()) {
+                    while (true) {
+                        side = owner.published.load();
+                        owner.readers[side][slot].value.fetch_add(1);
+                        if (owner.published.load() == side) break;
+                        owner.readers[side][slot].value.fetch_sub(1);
+                    }
+                }
+
+                ~Pin() { owner.readers[side][slot].value.fetch_sub(1); }
+
+                const ClientManager& replica() const { return *owner.replicas[side]; }
+        };
+
+    public:
+        ConcurrentClientManager() {
+            for (int side = 0; side < 2; side++) {
+                owned[side] = make_unique<ClientManager>();
+                replicas[side] = owned[side].get();
+            }
+        }
+
+        // From now on primary may only be changed through this; the writer's
+        // thread may still read it between writes, e.g. to save it.
+        explicit ConcurrentClientManager(ClientManager& primary) {
+            owned[1] = make_unique<ClientManager>();
+            primary.copyTo(*owned[1]);
+            replicas[0] = &primary;
+            replicas[1] = owned[1].get();
+        }
+
+        ConcurrentClientManager(const ConcurrentClientManager&) = delete;
+        ConcurrentClientManager& operator=(const ConcurrentClientManager&) = delete;
+
+        // Runs f(const ClientManager&) on the current version. Anything taken
+        // from the replica (references, slots) is only valid inside f.
+        template <typename F>
+        auto read(F&& f) const -> decltype(f(declval<const ClientManager&>())) {
+            Pin pin(*this);
+            return f(pin.replica());
+        }
+
+        // Number of versions published so far.
+        uint64_t getVersion() const { return version.load(); }
+
+        // Ops must be deterministic: each runs once per replica.
+        bool write(Operation op) {
+            lock_guard<mutex> guard(writeLock);
+            return apply({move(op)})[0];
+        }
+
+        // Applies ops as one version: readers see all of them or none.
+        vector<bool> writeBatch(const vector<Operation>& ops) {
+            lock_guard<mutex> guard(writeLock);
+            return apply(ops);
+        }
+
+        // Replaces both replicas, e.g. with FileManager::loadSnapshot. load
+        // runs twice and is not logged.
+        bool reset(const function<bool(ClientManager&)>& load) {
+            lock_guard<mutex> guard(writeLock);
+            int side = published.load();
+            if (!load(*replicas[1 - side])) return false;
+            published.store(1 - side);
+            version++;
+            waitForReaders(side);
+            return load(*replicas[side]);
+        }
+
+        void setChangeLog(ChangeLog* log) {
+            lock_guard<mutex> guard(writeLock);
+            changeLog = log;
+        }
+
+        // write() runs ops before returning, so they can capture by reference.
+        bool addClient(const Client& client) {
+            return write([&client](ClientManager& m) { return m.addClient(client); });
+        }
+
+        bool deleteById(const string& clientId) {
+            return write([&clientId](ClientManager& m) {
+                int slot = m.findById(clientId);
+                return slot >= 0 && m.removeClient(slot);
+            });
+        }
+
+        bool addInteraction(const string& clientId, const Appointment& appointment) {
+            return write([&clientId, &appointment](ClientManager& m) { return m.addInteraction(clientId, appointment); });
+        }
+
+        bool addInteraction(const string& clientId, const Contract& contract) {
+            return write([&clientId, &contract](ClientManager& m) { return m.addInteraction(clientId, contract); });
+        }
+
+        // Copies, since slots and references do not outlive the read.
+        vector<Client> searchClients(const string& searchTerm) const {
+            return read([&](const ClientManager& m) {
+                vector<Client> found;
+                for (int slot : m.searchClients(searchTerm)) found.push_back(m.getClients()[slot].toClient());
+                return found;
+            });
+        }
+
+        bool findById(const string& clientId, Client& out) const {
+            return read([&](const ClientManager& m) {
+                int slot = m.findById(clientId);
+                if (slot >= 0) out = m.getClients()[slot].toClient();
+                return slot >= 0;
+            });
+        }
+
+        size_t clientCount() const {
+            return read([](const ClientManager& m) { return m.clientCount(); });
+        }
+
+        void displayClientInteractions(const string& clientId) const {
+            read([&](const ClientManager& m) { m.displayClientInteractions(clientId); });
+        }
+
+        Reports::Totals contractTotals(unsigned threads = 1) const {
+            return read([&](const ClientManager& m) { return Reports::contractTotals(m.getInteractionStore(), threads); });
+        }
+
+        vector<Reports::Group> contractsByStatus(unsigned threads = 1) const {
+            // Group keys are interned names, so they stay valid after the read.
+            return read([&](const ClientManager& m) { return Reports::contractsByStatus(m.getInteractionStore(), threads); });
+        }
+};
+
+class CsvReader {
+    // Reads a CSV file in large blocks and splits each record into fields
+    // that point straight into the block buffer, so nothing is allocated per
+    // row. Quoted fields follow RFC 4180; doubled quotes are unescaped in place.
+    private:
+        static const size_t BLOCK_SIZE = 1 << 22;
+
+        ifstream file;
+        vector<char> buffer;
+        size_t begin = 0;
+        size_t end = 0;
+        bool eof = false;
+        size_t bytesRead = 0;
+
+        bool refill() {
+            if (eof) return false;
+            if (begin > 0) {
+                memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            if (end == buffer.size()) buffer.resize(buffer.size() * 2);
+            file.read(buffer.data() + end, buffer.size() - end);
+            size_t got = static_cast<size_t>(file.gcount());
+            if (got == 0) eof = true;
+            end += got;
+            bytesRead += got;
+            Metrics::addBytesRead(got);
+            return got > 0;
+        }
+
+    public:
+        // Returns the offset of the newline ending the record that starts at
+        // begin, or end when [begin, end) holds no complete record.
+        static size_t findRecordEnd(const char* data, size_t begin, size_t end) {
+            const char* nl = static_cast<const char*>(memchr(data + begin, '\n', end - begin));
+            size_t limit = nl ? static_cast<size_t>(nl - data) : end;
+            if (!memchr(data + begin, '"', limit - begin)) return limit;
+
+            bool inQuotes = false;
+            for (size_t i = begin; i < end; i++) {
+                if (data[i] == '"') inQuotes = !inQuotes;
+                else if (data[i] == '\n' && !inQuotes) return i;
+            }
+            return end;
+        }
+
+        // Splits one record (without its line terminator) into fields.
+        static void splitRecord(char* data, size_t length, vector<string_view>& fields) {
+            if (length > 0 && data[length - 1] == '\r') length--;
+
+            if (!memchr(data, '"', length)) {
+                size_t start = 0;
+                while (true) {
+                    const char* comma = static_cast<const char*>(memchr(data + start, ',', length - start));
+                    if (!comma) break;
+                    size_t pos = static_cast<size_t>(comma - data);
+                    fields.emplace_back(data + start, pos - start);
+                    start = pos + 1;
+                }
+                fields.emplace_back(data + start, length - start);
+                return;
+            }
+
+            size_t i = 0;
+            while (true) {
+                if (i < length && data[i] == '"') {
+                    size_t out = i;
+                    size_t start = i;
+                    i++;
+                    while (i < length) {
+                        if (data[i] == '"') {
+                            if (i + 1 < length && data[i + 1] == '"') {
+                                data[out++] = '"';
+                                i += 2;
+                                continue;
+                            }
+                            i++;
+                            break;
+                        }
+                        data[out++] = data[i++];
+                    }
+                    fields.emplace_back(data + start, out - start);
+                    while (i < length && data[i] != ',') i++;
+                } else {
+                    size_t start = i;
+                    while (i < length && data[i] != ',') i++;
+                    fields.emplace_back(data + start, i - start);
+                }
+                if (i >= length) break;
+                i++;
+            }
+        }
+
+        bool open(const string& filename) {
+            file.open(filename, ios::binary);
+            if (!file.is_open()) return false;
+            buffer.resize(BLOCK_SIZE);
+            return true;
+        }
+
+        // Fields stay valid until the next call.
+        bool nextRecord(vector<string_view>& fields) {
+            fields.clear();
+            size_t recordEnd = findRecordEnd(buffer.data(), begin, end);
+            while (recordEnd == end && !eof) {
+                size_t scanned = end - begin;
+                refill();
+                recordEnd = end - begin > scanned ? findRecordEnd(buffer.data(), begin, end) : end;
+            }
+            if (begin == end) return false;
+
+            splitRecord(buffer.data() + begin, recordEnd - begin, fields);
+            begin = recordEnd < end ? recordEnd + 1 : end;
+            return true;
+        }
+
+        size_t getBytesRead() const { return bytesRead; }
+};
+
+class AtomicFileWriter {
+    // Formats records into a large reusable buffer and hands it to the OS in
+    // big write() calls. Output goes to a temporary file that replaces the
+    // target only once it is completely written and synced, so a crash during
+    // a save leaves the previous file intact.
+    private:
+        static const size_t BUFFER_SIZE = 1 << 22;
+
+        string target;
+        string tempName;
+        int fd = -1;
+        vector<char> buffer;
+        size_t used = 0;
+        size_t bytesWritten = 0;
+        bool failed = false;
+
+        void writeOut(const char* data, size_t length) {
+            while (length > 0 && !failed) {
+                ssize_t n = ::write(fd, data, length);
+                if (n < 0) {
+                    failed = true;
+                    return;
+                }
+                data += n;
+                length -= static_cast<size_t>(n);
+                bytesWritten += static_cast<size_t>(n);
+                Metrics::addBytesWritten(static_cast<uint64_t>(n));
+            }
+        }
+
+        void flush() {
+            writeOut(buffer.data(), used);
+            used = 0;
+        }
+
+        char* reserve(size_t length) {
+            if (used + length > buffer.size()) flush();
+            return buffer.data() + used;
+        }
+
+    public:
+        AtomicFileWriter() = default;
+        AtomicFileWriter(const AtomicFileWriter&) = delete;
+        AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+        ~AtomicFileWriter() {
+            if (fd >= 0) {
+                ::close(fd);
+                ::unlink(tempName.c_str());
+            }
+        }
+
+        bool open(const string& filename) {
+            target = filename;
+            tempName = filename + ".tmp";
+            fd = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) return false;
+            buffer.resize(BUFFER_SIZE);
+            return true;
+        }
+
+        void put(char c) {
+            *reserve(1) = c;
+            used++;
+        }
+
+        void raw(string_view text) {
+            if (text.size() > buffer.size()) {
+                flush();
+                writeOut(text.data(), text.size());
+                return;
+            }
+            memcpy(reserve(text.size()), text.data(), text.size());
+            used += text.size();
+        }
+
+        // Writes a text field, quoting it per RFC 4180 only when needed.
+        void field(string_view text) {
+            if (text.find_first_of(",\"\r\n") == string_view::npos) {
+                raw(text);
+                return;
+            }
+            put('"');
+            size_t start = 0;
+            for (size_t quote = text.find('"'); quote != string_view::npos; quote = text.find('"', start)) {
+                raw(text.substr(start, quote + 1 - start));
+                put('"');
+                start = quote + 1;
+            }
+            raw(text.substr(start));
+            put('"');
+        }
+
+        void integer(long long value) {
+            char* out = reserve(24);
+            used += static_cast<size_t>(to_chars(out, out + 24, value).ptr - out);
+        }
+
+        // Two decimals, matching the fixed/setprecision(2) format used elsewhere.
+        void fixed2(double value) {
+            char* out = reserve(384);
+            used += static_cast<size_t>(to_chars(out, out + 384, value, chars_format::fixed, 2).ptr - out);
+        }
+
+        // Flushes, syncs and atomically renames the temporary file over the
+        // target, then syncs the directory so the rename itself survives a
+        // crash. Once this returns true the new file is durable, and whatever
+        // it supersedes (a log, say) can be dropped.
+        bool commit() {
+            flush();
+            if (!failed && ::fsync(fd) != 0) failed = true;
+            if (::close(fd) != 0) failed = true;
+            fd = -1;
+            if (failed || ::rename(tempName.c_str(), target.c_str()) != 0) {
+                ::unlink(tempName.c_str());
+                return false;
+            }
+            return syncDirectory(target);
+        }
+
+        // Syncs the directory holding path, making renames and creations in
+        // it durable.
+        static bool syncDirectory(const string& path) {
+            size_t slash = path.rfind('/');
+            string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+            int dir = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+            if (dir < 0) return false;
+            bool synced = ::fsync(dir) == 0;
+            ::close(dir);
+            return synced;
+        }
+
+        size_t getBytesWritten() const { return bytesWritten; }
+};
+
+namespace csv {
+    // Column layout of the CSV files: one row per interaction, or a single
+    // row with empty interaction columns for a client without any. The
+    // header, the formatter and the loader's column lookup are all generated
+    // from SCHEMA, so they cannot drift apart.
+    enum Column : uint8_t {
+        IdCard, FirstName, LastName, Email, PolicyNumber, CompanyName,
+        InteractionType, Description, SalesPerson, Date, Hour, Value, Status,
+        COLUMN_COUNT
+    };
+
+    // Rows that fill a column; every other row leaves it empty.
+    enum Fill : uint8_t { EVERY_ROW = 0, APPOINTMENT = 1, CONTRACT = 2, INTERACTION = APPOINTMENT | CONTRACT };
+
+    struct ColumnSpec {
+        const char* name;
+        uint8_t fill;
+    };
+
+    constexpr ColumnSpec SCHEMA[COLUMN_COUNT] = {
+        {"ID_Card", EVERY_ROW},
+        {"First_Name", EVERY_ROW},
+        {"Last_Name", EVERY_ROW},
+        {"Email", EVERY_ROW},
+        {"Policy_Number", EVERY_ROW},
+        {"Company_Name", EVERY_ROW},
+        {"Interaction_Type", INTERACTION},
+        {"Description", INTERACTION},
+        {"Sales_Person", APPOINTMENT},
+        {"Date", APPOINTMENT},
+        {"Hour", APPOINTMENT},
+        {"Value", CONTRACT},
+        {"Status", CONTRACT},
+    };
+    static_assert(SCHEMA[0].fill == EVERY_ROW, "the first column must be filled in every row");
+
+    // Row types: monostate for a client without interactions.
+    template <typename Row> constexpr uint8_t ROW_FILL = 0;
+    template <> constexpr uint8_t ROW_FILL<Appointment> = APPOINTMENT;
+    template <> constexpr uint8_t ROW_FILL<Contract> = CONTRACT;
+
+    constexpr bool fills(size_t column, uint8_t row) {
+        return SCHEMA[column].fill == EVERY_ROW || (SCHEMA[column].fill & row) != 0;
+    }
+
+    // Commas written before column, i.e. one per column since the previous
+    // filled one.
+    constexpr size_t gapBefore(size_t column, uint8_t row) {
+        size_t gap = 1;
+        while (column - gap > 0 && !fills(column - gap, row)) gap++;
+        return gap;
+    }
+
+    // Commas after the last filled column, before the newline.
+    constexpr size_t trailingGap(uint8_t row) {
+        size_t last = COLUMN_COUNT - 1;
+        while (!fills(last, row)) last--;
+        return COLUMN_COUNT - 1 - last;
+    }
+
+    constexpr size_t headerLength() {
+        size_t length = 0;
+        for (const auto& column : SCHEMA) length += char_traits<char>::length(column.name) + 1;
+        return length;
+    }
+
+    constexpr array<char, headerLength()> makeHeader() {
+        array<char, headerLength()> text{};
+        size_t n = 0;
+        for (size_t i = 0; i < COLUMN_COUNT; i++) {
+            for (const char* c = SCHEMA[i].name; *c; c++) text[n++] = *c;
+            text[n++] = i + 1 < COLUMN_COUNT ? ',' : '\n';
+        }
+        return text;
+    }
+
+    constexpr array<char, headerLength()> HEADER_TEXT = makeHeader();
+    // The header row, newline included.
+    constexpr string_view HEADER(HEADER_TEXT.data(), HEADER_TEXT.size());
+
+    // COLUMN_COUNT - 1 commas and a newline; separators are slices of it.
+    constexpr char SEPARATORS[] = ",,,,,,,,,,,,\n";
+    static_assert(sizeof(SEPARATORS) == COLUMN_COUNT + 1, "SEPARATORS must match the column count");
+
+    // Writes the value of column. Only instantiated for columns the row type
+    // fills, so a column whose getter a row lacks fails to compile.
+    template <Column C, typename ClientT, typename Row>
+    void formatValue(AtomicFileWriter& writer, const ClientT& client, const Row& row) {
+        if constexpr (C == IdCard) writer.field(client.getIdCard());
+        else if constexpr (C == FirstName) writer.field(client.getFirstName());
+        else if constexpr (C == LastName) writer.field(client.getLastName());
+        else if constexpr (C == Email) writer.field(client.getEmail());
+        else if constexpr (C == PolicyNumber) writer.integer(client.getPolicyNumber());
+        else if constexpr (C == CompanyName) writer.field(client.getCompany().getName());
+        else if constexpr (C == InteractionType) writer.raw(row.getType());
+        else if constexpr (C == Description) writer.field(row.getDescription());
+        else if constexpr (C == SalesPerson) writer.field(row.getSalesPerson());
+        else if constexpr (C == Date) writer.raw(row.getDate());
+        else if constexpr (C == Hour) writer.raw(row.getHour());
+        else if constexpr (C == Value) writer.fixed2(row.getValue());
+        else if constexpr (C == Status) writer.field(row.getStatus());
+        else static_assert(C != C, "column has no formatter");
+    }
+
+    template <size_t C, typename ClientT, typename Row>
+    void formatColumn(AtomicFileWriter& writer, const ClientT& client, const Row& row) {
+        constexpr uint8_t fill = ROW_FILL<Row>;
+        if constexpr (fills(C, fill)) {
+            if constexpr (C > 0) writer.raw(string_view(SEPARATORS, gapBefore(C, fill)));
+            formatValue<static_cast<Column>(C)>(writer, client, row);
+        }
+    }
+
+    template <typename ClientT, typename Row, size_t... C>
+    void formatColumns(AtomicFileWriter& writer, const ClientT& client, const Row& row, index_sequence<C...>) {
+        (formatColumn<C>(writer, client, row), ...);
+        constexpr size_t trailing = trailingGap(ROW_FILL<Row>);
+        writer.raw(string_view(SEPARATORS + COLUMN_COUNT - 1 - trailing, trailing + 1));
+    }
+
+    // Writes one row for client and row (an Appointment, a Contract, or
+    // monostate for a client without interactions). The column sequence is
+    // unrolled per row type, with the empty columns as constant runs of commas.
+    template <typename ClientT, typename Row>
+    void formatRow(AtomicFileWriter& writer, const ClientT& client, const Row& row) {
+        formatColumns(writer, client, row, make_index_sequence<COLUMN_COUNT>());
+    }
+
+    // The columns a row needs to make a client.
+    constexpr Column KEY_COLUMNS[] = {IdCard, FirstName, LastName, PolicyNumber};
+
+    // Where each schema column sits in a file, as named by its header row.
+    // Columns the file lacks read as empty and unknown ones are ignored.
+    class Layout {
+        private:
+            array<uint32_t, COLUMN_COUNT> position;
+            size_t width = COLUMN_COUNT;
+
+        public:
+            Layout() {
+                for (size_t i = 0; i < COLUMN_COUNT; i++) position[i] = static_cast<uint32_t>(i);
+            }
+
+            // Returns false, keeping the schema order, unless every key column
+            // is named: without them each row would be dropped, so a header
+            // naming only some columns is more likely misspelt than reordered.
+            bool readHeader(const vector<string_view>& names) {
+                array<uint32_t, COLUMN_COUNT> found;
+                found.fill(static_cast<uint32_t>(names.size()));
+                for (size_t i = 0; i < names.size(); i++) {
+                    string_view name = names[i];
+                    if (i == 0 && name.substr(0, 3) == "\xEF\xBB\xBF") name.remove_prefix(3);
+                    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+                        if (name != SCHEMA[c].name || found[c] != names.size()) continue;
+                        found[c] = static_cast<uint32_t>(i);
+                    }
+                }
+                for (Column key : KEY_COLUMNS) {
+                    if (found[key] == names.size()) return false;
+                }
+                position = found;
+                width = names.size();
+                return true;
+            }
+
+            // Makes every column of a record readable with at(): a short
+            // record is padded, and one slot past the width stays empty for
+            // the columns the file lacks.
+            void fit(vector<string_view>& fields) const {
+                fields.resize(width);
+                fields.emplace_back();
+            }
+
+            string_view at(const vector<string_view>& fields, Column column) const { return fields[position[column]]; }
+    };
+}
+
+namespace snapshot {
+    // Binary snapshot layout (native little-endian):
+    //   Header | string blob | ClientRecord[clientCount] | InteractionRecord[interactionCount]
+    // Clients are stored in slot order and each one's interactions are
+    // contiguous, starting at firstInteraction. Every section carries its own
+    // checksum; the header is validated on open, sections on verify().
+    // Records are not served from the mapping: FileManager::loadSnapshot()
+    // copies them all into a ClientManager, so a snapshot load is still
+    // linear in the data. It only skips parsing CSV text.
+    const char MAGIC[8] = {'C', 'R', 'M', 'S', 'N', 'A', 'P', '\0'};
+    const uint32_t VERSION = 3;
+
+    enum Section { STRINGS = 0, CLIENTS = 1, INTERACTIONS = 2, SECTION_COUNT = 3 };
+
+    struct StringRef {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t reserved;
+    };
+
+    struct SectionInfo {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t clientCount;
+        uint64_t interactionCount;
+        uint64_t logSequence;
+        SectionInfo sections[SECTION_COUNT];
+        uint64_t headerChecksum;
+    };
+
+    struct ClientRecord {
+        StringRef idCard;
+        StringRef firstName;
+        StringRef lastName;
+        StringRef email;
+        StringRef company;
+        int32_t policyNumber;
+        uint32_t interactionCount;
+        uint64_t firstInteraction;
+    };
+
+    // For appointments a is the sales person and time the start in minutes
+    // since the epoch; for contracts a is the status and value is used.
+    struct InteractionRecord {
+        uint32_t kind;
+        uint32_t reserved;
+        StringRef description;
+        StringRef a;
+        int64_t time;
+        double value;
+    };
+
+    inline uint64_t checksum(const char* data, size_t length) {
+        uint64_t h = 0x9E3779B97F4A7C15ULL ^ length;
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            h = (h ^ word) * 0x100000001B3ULL;
+            h ^= h >> 29;
+        }
+        for (; i < length; i++) {
+            h = (h ^ static_cast<unsigned char>(data[i])) * 0x100000001B3ULL;
+        }
+        return h;
+    }
+
+    // Opens a snapshot by mapping it and checking the header; record access
+    // is then direct into the mapping.
+    class Reader {
+        private:
+            const char* base = nullptr;
+            size_t fileSize = 0;
+            const Header* header = nullptr;
+
+        public:
+            Reader() = default;
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            ~Reader() {
+                if (base) munmap(const_cast<char*>(base), fileSize);
+            }
+
+            bool open(const string& filename) {
+                int fd = ::open(filename.c_str(), O_RDONLY);
+                if (fd < 0) return false;
+                struct stat info;
+                if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+                    ::close(fd);
+                    return false;
+                }
+                fileSize = static_cast<size_t>(info.st_size);
+                void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (mapped == MAP_FAILED) return false;
+                Metrics::addBytesRead(fileSize);
+                base = static_cast<const char*>(mapped);
+                header = reinterpret_cast<const Header*>(base);
+
+                if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION ||
+                    header->headerSize != sizeof(Header) ||
+                    header->headerChecksum != checksum(base, offsetof(Header, headerChecksum))) {
+                    return false;
+                }
+                for (const auto& section : header->sections) {
+                    if (section.offset > fileSize || section.size > fileSize - section.offset) return false;
+                }
+                return header->sections[CLIENTS].size == header->clientCount * sizeof(ClientRecord) &&
+                       header->sections[INTERACTIONS].size == header->interactionCount * sizeof(InteractionRecord);
+            }
+
+            bool verify() const {
+                for (const auto& section : header->sections) {
+                    if (checksum(base + section.offset, section.size) != section.checksum) return false;
+                }
+                return true;
+            }
+
+            size_t clientCount() const { return header->clientCount; }
+            size_t interactionCount() const { return header->interactionCount; }
+            uint64_t logSequence() const { return header->logSequence; }
+
+            const ClientRecord& client(size_t i) const {
+                return reinterpret_cast<const ClientRecord*>(base + header->sections[CLIENTS].offset)[i];
+            }
+
+            const InteractionRecord& interaction(size_t i) const {
+                return reinterpret_cast<const InteractionRecord*>(base + header->sections[INTERACTIONS].offset)[i];
+            }
+
+            // Empty if the reference points outside the string section.
+            string_view str(const StringRef& ref) const {
+                const SectionInfo& strings = header->sections[STRINGS];
+                if (ref.offset > strings.size || ref.length > strings.size - ref.offset) return string_view();
+                return string_view(base + strings.offset + ref.offset, ref.length);
+            }
+    };
+}
+
+namespace packed {
+    // Compressed data file (.crz) layout:
+    //   MAGIC | block... | BlockInfo[blockCount] | Trailer
+    // A block holds the clients of a range of slots, each stored once with
+    // its interactions after it in column order, and is compressed on its
+    // own, so blocks can be encoded and decoded on separate threads. The
+    // trailer is written last and locates the block index; both carry a
+    // checksum, and every block is checked before it is decoded.
+    const char MAGIC[8] = {'C', 'R', 'M', 'P', 'A', 'C', 'K', '\0'};
+    const uint32_t VERSION = 1;
+
+    // Slots per block: large enough for the dictionary and the compressor
+    // to find repeats, small enough to spread a load over the workers.
+    const size_t BLOCK_SLOTS = 1 << 14;
+
+    // Packed files are told apart from CSV by their extension.
+    inline bool isPackedFile(const string& filename) {
+        return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".crz") == 0;
+    }
+
+    struct BlockInfo {
+        uint64_t offset;
+        uint32_t compressedSize;
+        uint32_t rawSize;
+        uint32_t clients;
+        uint32_t interactions;
+        uint64_t checksum;
+    };
+
+    struct Trailer {
+        uint64_t indexOffset;
+        uint64_t blockCount;
+        uint64_t clientCount;
+        uint64_t interactionCount;
+        uint64_t logSequence;
+        // Size of the decompressed blocks, for the compression ratio.
+        uint64_t rawBytes;
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t indexChecksum;
+        uint64_t trailerChecksum;
+        char magic[8];
+    };
+
+    // Inside a block every column is a run of varints, length-prefixed
+    // strings or raw doubles. Text that repeats (names, company, sales
+    // person, status, description) is replaced by its index in the block's
+    // dictionary; IDs and emails are unique and stored as they are.
+    enum BlockColumn {
+        ID_CARD, FIRST_NAME, LAST_NAME, EMAIL, POLICY_NUMBER, COMPANY, INTERACTION_COUNT,
+        KIND, DESCRIPTION, SYMBOL, TIME, VALUE, BLOCK_COLUMN_COUNT
+    };
+
+    inline void putVarint(string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    // Signed values as varints, small magnitudes in few bytes.
+    inline uint64_t zigzag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+    inline int64_t unzigzag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+    inline void putString(string& out, string_view text) {
+        putVarint(out, text.size());
+        out.append(text.data(), text.size());
+    }
+
+    // Reads what the put* functions wrote; any overrun clears ok and
+    // yields zeros, so a damaged block decodes to garbage but never
+    // reads out of bounds.
+    struct Cursor {
+        const char* data = nullptr;
+        size_t size = 0;
+        size_t pos = 0;
+        bool ok = true;
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (pos >= size) break;
+                uint8_t byte = static_cast<uint8_t>(data[pos++]);
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+            ok = false;
+            return 0;
+        }
+
+        string_view str() {
+            uint64_t length = varint();
+            if (!ok || length > size - pos) {
+                ok = false;
+                return string_view();
+            }
+            string_view text(data + pos, length);
+            pos += length;
+            return text;
+        }
+
+        double real() {
+            double value = 0;
+            if (size - pos < sizeof(value)) {
+                ok = false;
+                return 0;
+            }
+            memcpy(&value, data + pos, sizeof(value));
+            pos += sizeof(value);
+            return value;
+        }
+    };
+
+    // LZ77 codec in the manner of LZ4. A sequence is a token byte (literal
+    // count in the high nibble, match length - MIN_MATCH in the low one, 15
+    // meaning extra length bytes follow, each 255 saying "and more"), the
+    // literals, and a two-byte little-endian offset back to the match. The
+    // final sequence has literals only.
+    const size_t MIN_MATCH = 4;
+    const size_t MAX_OFFSET = 65535;
+    const unsigned HASH_BITS = 16;
+
+    inline void putLength(string& out, size_t length) {
+        for (; length >= 255; length -= 255) out.push_back(static_cast<char>(255));
+        out.push_back(static_cast<char>(length));
+    }
+
+    inline void putSequence(string& out, const char* literals, size_t literalCount, size_t matchLength, size_t offset) {
+        size_t extra = matchLength - MIN_MATCH;
+        uint8_t token = static_cast<uint8_t>((min<size_t>(literalCount, 15) << 4) | min<size_t>(extra, 15));
+        out.push_back(static_cast<char>(token));
+        if (literalCount >= 15) putLength(out, literalCount - 15);
+        out.append(literals, literalCount);
+        out.push_back(static_cast<char>(offset & 0xFF));
+        out.push_back(static_cast<char>(offset >> 8));
+        if (extra >= 15) putLength(out, extra - 15);
+    }
+
+    inline void compress(const char* in, size_t size, string& out) {
+        out.clear();
+        out.reserve(size / 2 + 16);
+        // Last position + 1 of each hashed 4-byte sequence; 0 is empty.
+        vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+        size_t anchor = 0;
+        size_t pos = 0;
+        while (pos + MIN_MATCH <= size) {
+            uint32_t sequence;
+            memcpy(&sequence, in + pos, sizeof(sequence));
+            uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(pos + 1);
+            if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || memcmp(in + candidate - 1, in + pos, MIN_MATCH) != 0) {
+                pos++;
+                continue;
+            }
+            size_t match = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (pos + length < size && in[match + length] == in[pos + length]) length++;
+            while (pos > anchor && match > 0 && in[pos - 1] == in[match - 1]) {
+                pos--;
+                match--;
+                length++;
+            }
+            putSequence(out, in + anchor, pos - anchor, length, pos - match);
+            pos += length;
+            anchor = pos;
+        }
+        size_t literalCount = size - anchor;
+        out.push_back(static_cast<char>(min<size_t>(literalCount, 15) << 4));
+        if (literalCount >= 15) putLength(out, literalCount - 15);
+        out.append(in + anchor, literalCount);
+    }
+
+    // False unless in decodes to exactly rawSize bytes.
+    inline bool decompress(const char* in, size_t size, char* out, size_t rawSize) {
+        const uint8_t* ip = reinterpret_cast<const uint8_t*>(in);
+        const uint8_t* end = ip + size;
+        auto readLength = [&](size_t& length) {
+            while (ip < end) {
+                uint8_t byte = *ip++;
+                length += byte;
+                if (byte != 255) return true;
+            }
+            return false;
+        };
+        size_t op = 0;
+        while (ip < end) {
+            uint8_t token = *ip++;
+            size_t literals = token >> 4;
+            if (literals == 15 && !readLength(literals)) return false;
+            if (literals > static_cast<size_t>(end - ip) || literals > rawSize - op) return false;
+            memcpy(out + op, ip, literals);
+            ip += literals;
+            op += literals;
+            if (ip == end) break;
+
+            if (end - ip < 2) return false;
+            size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+            ip += 2;
+            size_t length = token & 15;
+            if (length == 15 && !readLength(length)) return false;
+            length += MIN_MATCH;
+            if (offset == 0 || offset > op || length > rawSize - op) return false;
+            if (offset >= length) {
+                memcpy(out + op, out + op - offset, length);
+            } else {
+                for (size_t i = 0; i < length; i++) out[op + i] = out[op + i - offset];
+            }
+            op += length;
+        }
+        return op == rawSize;
+    }
+
+    // Maps a .crz file and checks its trailer and block index; blocks are
+    // then read straight from the mapping.
+    class Reader {
+        private:
+            const char* base = nullptr;
+            size_t fileSize = 0;
+            const Trailer* trailer = nullptr;
+            const BlockInfo* index = nullptr;
+
+        public:
+            Reader() = default;
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            ~Reader() {
+                if (base) munmap(const_cast<char*>(base), fileSize);
+            }
+
+            bool open(const string& filename) {
+                int fd = ::open(filename.c_str(), O_RDONLY);
+                if (fd < 0) return false;
+                struct stat info;
+                if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(MAGIC) + sizeof(Trailer)) {
+                    ::close(fd);
+                    return false;
+                }
+                fileSize = static_cast<size_t>(info.st_size);
+                void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (mapped == MAP_FAILED) return false;
+                Metrics::addBytesRead(fileSize);
+                base = static_cast<const char*>(mapped);
+                trailer = reinterpret_cast<const Trailer*>(base + fileSize - sizeof(Trailer));
+
+                if (memcmp(base, MAGIC, sizeof(MAGIC)) != 0 || memcmp(trailer->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+                    trailer->version != VERSION ||
+                    trailer->trailerChecksum != snapshot::checksum(reinterpret_cast<const char*>(trailer),
+                                                                   offsetof(Trailer, trailerChecksum))) {
+                    return false;
+                }
+                size_t indexEnd = fileSize - sizeof(Trailer);
+                if (trailer->indexOffset > indexEnd || trailer->blockCount > (indexEnd - trailer->indexOffset) / sizeof(BlockInfo) ||
+                    trailer->indexOffset + trailer->blockCount * sizeof(BlockInfo) != indexEnd) {
+                    return false;
+                }
+                index = reinterpret_cast<const BlockInfo*>(base + trailer->indexOffset);
+                if (snapshot::checksum(base + trailer->indexOffset, indexEnd - trailer->indexOffset) != trailer->indexChecksum) {
+                    return false;
+                }
+                for (size_t i = 0; i < trailer->blockCount; i++) {
+                    if (index[i].offset > trailer->indexOffset || index[i].compressedSize > trailer->indexOffset - index[i].offset) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            size_t blockCount() const { return trailer->blockCount; }
+            size_t clientCount() const { return trailer->clientCount; }
+            size_t interactionCount() const { return trailer->interactionCount; }
+            uint64_t logSequence() const { return trailer->logSequence; }
+            uint64_t rawBytes() const { return trailer->rawBytes; }
+            size_t size() const { return fileSize; }
+
+            const BlockInfo& block(size_t i) const { return index[i]; }
+
+            // Decompresses block i into raw; false if it is damaged.
+            bool read(size_t i, string& raw) const {
+                const BlockInfo& info = index[i];
+                const char* data = base + info.offset;
+                if (snapshot::checksum(data, info.compressedSize) != info.checksum) return false;
+                raw.resize(info.rawSize);
+                return decompress(data, info.compressedSize, &raw[0], info.rawSize);
+            }
+    };
+}
+
+class FileManager {
+    private:
+        // One decoded data row. Views point into the reader's buffer.
+        struct LoadedRow {
+            string_view idCard;
+            string_view policyStr;
+            string_view valueStr;
+            string_view dateStr;
+            string_view hourStr;
+            bool validPolicy = false;
+            bool validValue = true;
+            bool validTime = true;
+            int client = -1;
+            variant<monostate, Appointment, Contract> interaction;
+            // The row in schema order, only kept if its time is invalid.
+            vector<string> record;
+        };
+
+        struct LoadedChunk {
+            vector<LoadedRow> rows;
+            vector<ClientView> clients;
+        };
+
+        // Appointments whose date or hour does not parse. There is no time to
+        // store for them, so their rows are set aside in a rejects file; the
+        // first few are listed.
+        struct InvalidTimes {
+            static const size_t LISTED = 10;
+            size_t count = 0;
+            string listing;
+            vector<vector<string>> records;
+
+            void add(size_t record, LoadedRow& row) {
+                if (count++ < LISTED) {
+                    listing += "  record " + to_string(record) + ", client " + string(row.idCard) + ": '" +
+                               string(row.dateStr) + " " + string(row.hourStr) + "'\n";
+                }
+                records.push_back(move(row.record));
+            }
+        };
+
+        // Files smaller than this are not worth splitting across threads.
+        static const size_t PARALLEL_MIN_BYTES = 1 << 20;
+
+        // Decodes a record, already passed through layout.fit(), into row; a
+        // client is only built when buildClient is set. Its fields view the
+        // record, so it must be added while that lives.
+        static void decodeRow(const vector<string_view>& fields, const csv::Layout& layout, LoadedRow& row,
+                              vector<ClientView>& clients, bool buildClient) {
+            auto column = [&](csv::Column c) { return layout.at(fields, c); };
+            row.idCard = column(csv::IdCard);
+            row.policyStr = column(csv::PolicyNumber);
+            row.valueStr = column(csv::Value);
+
+            int policyNumber = 0;
+            auto parsedPolicy = from_chars(row.policyStr.data(), row.policyStr.data() + row.policyStr.size(), policyNumber);
+            row.validPolicy = parsedPolicy.ec == errc() && !row.policyStr.empty();
+
+            if (buildClient && row.validPolicy) {
+                row.client = static_cast<int>(clients.size());
+                clients.emplace_back(row.idCard, column(csv::FirstName), column(csv::LastName), column(csv::Email),
+                                     policyNumber, Company(column(csv::CompanyName)));
+            }
+
+            string_view interactionType = column(csv::InteractionType);
+            if (interactionType == Interaction::typeName(InteractionKind::Appointment)) {
+                row.dateStr = column(csv::Date);
+                row.hourStr = column(csv::Hour);
+                AppointmentTime when;
+                row.validTime = AppointmentTime::parse(row.dateStr, row.hourStr, when);
+                if (row.validTime) {
+                    row.interaction = Appointment(string(column(csv::Description)), column(csv::SalesPerson), when);
+                } else {
+                    for (size_t c = 0; c < csv::COLUMN_COUNT; c++) row.record.emplace_back(column(static_cast<csv::Column>(c)));
+                }
+            } else if (interactionType == Interaction::typeName(InteractionKind::Contract)) {
+                double value = 0.0;
+                if (!row.valueStr.empty()) {
+                    auto parsedValue = from_chars(row.valueStr.data(), row.valueStr.data() + row.valueStr.size(), value);
+                    if (parsedValue.ec != errc()) {
+                        value = 0.0;
+                        row.validValue = false;
+                    }
+                }
+                row.interaction = Contract(string(column(csv::Description)), value, column(csv::Status));
+            }
+        }
+
+        // Applies a decoded row to the manager: the first row of an ID with a
+        // valid policy number creates the client, every row adds its interaction.
+        static void applyRow(LoadedRow& row, vector<ClientView>& clients, ClientManager& manager) {
+            if (!row.validValue) {
+                cout << "Warning: Invalid contract value '" << row.valueStr << "', using 0.0\n";
+            }
+            int slot = manager.findById(row.idCard);
+            if (slot < 0) {
+                if (!row.validPolicy || row.client < 0) {
+                    cout << "Error loading data: invalid policy number '" << row.policyStr << "' for client " << row.idCard << "\n";
+                    return;
+                }
+                manager.addClient(clients[row.client]);
+                slot = manager.findById(row.idCard);
+            }
+
+            if (auto* apt = get_if<Appointment>(&row.interaction)) manager.addInteraction(slot, move(*apt));
+            else if (auto* contract = get_if<Contract>(&row.interaction)) manager.addInteraction(slot, move(*contract));
+        }
+
+        static bool isBlankRecord(const vector<string_view>& fields) {
+            return fields.size() == 1 && fields[0].empty();
+        }
+
+        static void parseChunk(vector<char>& data, size_t begin, size_t end, const csv::Layout& layout, LoadedChunk& chunk) {
+            vector<string_view> fields;
+            unordered_set<string_view> builtIds;
+            size_t pos = begin;
+            while (pos < end) {
+                size_t recordEnd = CsvReader::findRecordEnd(data.data(), pos, end);
+                fields.clear();
+                CsvReader::splitRecord(data.data() + pos, recordEnd - pos, fields);
+                pos = recordEnd + 1;
+                if (isBlankRecord(fields)) continue;
+
+                LoadedRow row;
+                layout.fit(fields);
+                bool buildClient = builtIds.find(layout.at(fields, csv::IdCard)) == builtIds.end();
+                decodeRow(fields, layout, row, chunk.clients, buildClient);
+                if (row.client >= 0) builtIds.insert(row.idCard);
+                chunk.rows.push_back(move(row));
+            }
+        }
+
+        // Splits [begin, end) into record-aligned chunks. Quote parity at each
+        // nominal cut is found from per-slice quote counts, so a newline inside
+        // a quoted field is never taken as a boundary.
+        static vector<size_t> chunkBoundaries(const vector<char>& data, size_t begin, size_t end, size_t chunks, unsigned threads) {
+            vector<size_t> cuts(chunks + 1);
+            for (size_t i = 0; i <= chunks; i++) cuts[i] = begin + (end - begin) * i / chunks;
+
+            vector<size_t> quotes(chunks, 0);
+            atomic<size_t> next(0);
+            vector<thread> workers;
+            for (unsigned t = 0; t < threads; t++) {
+                workers.emplace_back([&]() {
+                    for (size_t i = next++; i < chunks; i = next++) {
+                        quotes[i] = static_cast<size_t>(count(data.begin() + cuts[i], data.begin() + cuts[i + 1], '"'));
+                    }
+                });
+            }
+            for (auto& worker : workers) worker.join();
+
+            vector<size_t> boundaries{begin};
+            size_t quoteCount = 0;
+            for (size_t i = 1; i < chunks; i++) {
+                quoteCount += quotes[i - 1];
+                bool inQuotes = quoteCount % 2 == 1;
+                size_t pos = cuts[i];
+                while (pos < end && (data[pos] != '\n' || inQuotes)) {
+                    if (data[pos] == '"') inQuotes = !inQuotes;
+                    pos++;
+                }
+                if (pos < end) pos++;
+                if (pos > boundaries.back()) boundaries.push_back(pos);
+            }
+            if (boundaries.back() != end) boundaries.push_back(end);
+            return boundaries;
+        }
+
+        static size_t loadSequential(CsvReader& reader, const csv::Layout& layout, ClientManager& manager,
+                                     InvalidTimes& invalid) {
+            vector<string_view> fields;
+            vector<ClientView> clients;
+            size_t rows = 0;
+            while (reader.nextRecord(fields)) {
+                if (isBlankRecord(fields)) continue;
+                rows++;
+
+                LoadedRow row;
+                clients.clear();
+                layout.fit(fields);
+                decodeRow(fields, layout, row, clients, manager.findById(layout.at(fields, csv::IdCard)) < 0);
+                if (!row.validTime) invalid.add(rows, row);
+                applyRow(row, clients, manager);
+            }
+            return rows;
+        }
+
+        // Reads the header record at the start of data into layout and returns
+        // the offset of the first data record.
+        static size_t readHeader(vector<char>& data, csv::Layout& layout, bool& known) {
+            size_t headerEnd = CsvReader::findRecordEnd(data.data(), 0, data.size());
+            vector<string_view> names;
+            CsvReader::splitRecord(data.data(), headerEnd, names);
+            known = layout.readHeader(names);
+            return min(headerEnd + 1, data.size());
+        }
+
+        static size_t loadParallel(vector<char>& data, size_t begin, const csv::Layout& layout, ClientManager& manager,
+                                   unsigned threads, InvalidTimes& invalid) {
+            size_t end = data.size();
+            vector<size_t> boundaries = chunkBoundaries(data, begin, end, static_cast<size_t>(threads) * 4, threads);
+            size_t chunkCount = boundaries.size() - 1;
+
+            vector<LoadedChunk> chunks(chunkCount);
+            vector<promise<void>> ready(chunkCount);
+            atomic<size_t> next(0);
+            vector<thread> workers;
+            for (unsigned t = 0; t < threads; t++) {
+                workers.emplace_back([&]() {
+                    for (size_t i = next++; i < chunkCount; i = next++) {
+                        parseChunk(data, boundaries[i], boundaries[i + 1], layout, chunks[i]);
+                        ready[i].set_value();
+                    }
+                });
+            }
+
+            // Merge in file order while later chunks are still being parsed.
+            size_t rows = 0;
+            for (size_t i = 0; i < chunkCount; i++) {
+                ready[i].get_future().wait();
+                for (auto& row : chunks[i].rows) {
+                    rows++;
+                    if (!row.validTime) invalid.add(rows, row);
+                    applyRow(row, chunks[i].clients, manager);
+                }
+                chunks[i] = LoadedChunk();
+            }
+            for (auto& worker : workers) worker.join();
+            return rows;
+        }
+
+        static bool readWholeFile(const string& filename, vector<char>& data) {
+            ifstream file(filename, ios::binary | ios::ate);
+            if (!file.is_open()) return false;
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), static_cast<streamsize>(data.size()));
+            Metrics::addBytesRead(static_cast<uint64_t>(file.gcount()));
+            return static_cast<bool>(file);
+        }
+
+        static void warnUnknownHeader(const string& filename) {
+            string keys;
+            for (csv::Column key : csv::KEY_COLUMNS) keys += string(keys.empty() ? "" : ", ") + csv::SCHEMA[key].name;
+            cout << "Warning: the header of " << filename << " does not name all of " << keys
+                 << "; assuming the standard column order.\n";
+        }
+
+        // A file none of whose rows made a client was most likely misread;
+        // loading it as empty would let the next save supersede it.
+        static bool rejectEmptyLoad(const string& filename, ClientManager& manager, size_t rows) {
+            manager.clear();
+            manager.endBulkLoad(true);
+            cout << "Error: none of the " << rows << " row(s) in " << filename
+                 << " could be loaded; check its header and columns. Nothing was loaded.\n";
+            return false;
+        }
+
+        static void reportLoad(const string& filename, const ClientManager& manager, size_t rows, size_t bytes,
+                               chrono::steady_clock::time_point startTime) {
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            double megabytes = bytes / (1024.0 * 1024.0);
+            cout << "Data loaded from " << filename << " successfully! (" << manager.clientCount() << " clients)\n";
+            stringstream stats;
+            stats << fixed << setprecision(2)
+                  << "Parsed " << rows << " rows (" << megabytes << " MB) in " << seconds << " s: "
+                  << (seconds > 0 ? rows / seconds : 0.0) << " rows/s, "
+                  << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/s\n";
+            cout << stats.str();
+        }
+
+        // Appends text to the snapshot string blob.
+        static snapshot::StringRef addString(vector<char>& blob, string_view text) {
+            snapshot::StringRef ref{blob.size(), static_cast<uint32_t>(text.size()), 0};
+            blob.insert(blob.end(), text.begin(), text.end());
+            return ref;
+        }
+
+        // Interned values are written once each, cached by symbol id.
+        static snapshot::StringRef addSymbol(vector<char>& blob, uint32_t id, vector<snapshot::StringRef>& written) {
+            const uint64_t unwritten = ~uint64_t(0);
+            if (id >= written.size()) written.resize(symbols().size(), snapshot::StringRef{unwritten, 0, 0});
+            if (written[id].offset == unwritten) written[id] = addString(blob, symbols().name(id));
+            return written[id];
+        }
+
+        // Writes the rows of the live clients in slots [begin, end).
+        static size_t writeRows(AtomicFileWriter& writer, const ClientManager& manager, size_t begin, size_t end) {
+            const auto& clients = manager.getClients();
+            const InteractionStore& store = manager.getInteractionStore();
+            size_t rows = 0;
+
+            for (size_t i = begin; i < end; i++) {
+                if (!manager.isLive(static_cast<int>(i))) continue;
+                const ClientRecord& client = clients[i];
+                const auto& interactions = manager.getInteractions(static_cast<int>(i));
+                if (interactions.empty()) {
+                    csv::formatRow(writer, client, monostate());
+                    rows++;
+                    continue;
+                }
+                for (const auto& ref : interactions) {
+                    if (ref.kind == InteractionKind::Appointment) csv::formatRow(writer, client, store.appointment(ref));
+                    else csv::formatRow(writer, client, store.contract(ref));
+                    rows++;
+                }
+            }
+            return rows;
+        }
+
+        // Encodes the live clients in slots [begin, end) as a packed block.
+        static void encodeBlock(const ClientManager& manager, size_t begin, size_t end, string& raw,
+                                uint32_t& clientCount, uint32_t& interactionCount) {
+            using namespace packed;
+            const auto& clients = manager.getClients();
+            const InteractionStore& store = manager.getInteractionStore();
+            array<string, BLOCK_COLUMN_COUNT> columns;
+            vector<string_view> dictionary;
+            unordered_map<string_view, uint32_t> codes;
+            auto word = [&](string& column, string_view text) {
+                auto entry = codes.try_emplace(text, static_cast<uint32_t>(dictionary.size()));
+                if (entry.second) dictionary.push_back(text);
+                putVarint(column, entry.first->second);
+            };
+
+            int64_t lastPolicy = 0, lastTime = 0;
+            clientCount = interactionCount = 0;
+            for (size_t i = begin; i < end; i++) {
+                if (!manager.isLive(static_cast<int>(i))) continue;
+                const ClientRecord& client = clients[i];
+                putString(columns[ID_CARD], client.getIdCard());
+                word(columns[FIRST_NAME], client.getFirstName());
+                word(columns[LAST_NAME], client.getLastName());
+                putString(columns[EMAIL], client.getEmail());
+                putVarint(columns[POLICY_NUMBER], zigzag(client.getPolicyNumber() - lastPolicy));
+                lastPolicy = client.getPolicyNumber();
+                word(columns[COMPANY], client.getCompany().getName());
+
+                const auto& refs = manager.getInteractions(static_cast<int>(i));
+                putVarint(columns[INTERACTION_COUNT], refs.size());
+                for (const auto& ref : refs) {
+                    putVarint(columns[KIND], static_cast<uint64_t>(ref.kind));
+                    if (ref.kind == InteractionKind::Appointment) {
+                        const Appointment& apt = store.appointment(ref);
+                        word(columns[DESCRIPTION], apt.getDescription());
+                        word(columns[SYMBOL], apt.getSalesPerson());
+                        putVarint(columns[TIME], zigzag(apt.getTime().getMinutes() - lastTime));
+                        lastTime = apt.getTime().getMinutes();
+                    } else {
+                        const Contract& contract = store.contract(ref);
+                        word(columns[DESCRIPTION], contract.getDescription());
+                        word(columns[SYMBOL], contract.getStatus());
+                        double value = contract.getValue();
+                        columns[VALUE].append(reinterpret_cast<const char*>(&value), sizeof(value));
+                    }
+                }
+                clientCount++;
+                interactionCount += static_cast<uint32_t>(refs.size());
+            }
+
+            raw.clear();
+            putVarint(raw, clientCount);
+            putVarint(raw, interactionCount);
+            putVarint(raw, dictionary.size());
+            for (string_view text : dictionary) putString(raw, text);
+            for (const auto& column : columns) putVarint(raw, column.size());
+            for (const auto& column : columns) raw += column;
+        }
+
+        // One decoded packed block. The client views point into raw.
+        struct PackedBlock {
+            string raw;
+            vector<ClientView> clients;
+            vector<uint32_t> interactionCounts;
+            vector<variant<Appointment, Contract>> interactions;
+        };
+
+        static bool decodeBlock(const packed::Reader& reader, size_t index, PackedBlock& block) {
+            using namespace packed;
+            if (!reader.read(index, block.raw)) return false;
+            Cursor header{block.raw.data(), block.raw.size()};
+            uint64_t clientCount = header.varint();
+            uint64_t interactionCount = header.varint();
+            uint64_t dictionarySize = header.varint();
+            // Every entry takes at least a byte, which bounds the reserves below.
+            if (!header.ok || clientCount > block.raw.size() || interactionCount > block.raw.size() ||
+                dictionarySize > block.raw.size()) {
+                return false;
+            }
+            vector<string_view> dictionary(dictionarySize);
+            for (auto& text : dictionary) text = header.str();
+
+            array<Cursor, BLOCK_COLUMN_COUNT> columns;
+            for (auto& column : columns) column.size = header.varint();
+            size_t start = header.pos;
+            for (auto& column : columns) {
+                if (!header.ok || column.size > block.raw.size() - start) return false;
+                column.data = block.raw.data() + start;
+                start += column.size;
+            }
+            auto word = [&](Cursor& column) {
+                uint64_t code = column.varint();
+                if (code < dictionary.size()) return dictionary[code];
+                column.ok = false;
+                return string_view();
+            };
+
+            block.clients.reserve(clientCount);
+            block.interactionCounts.reserve(clientCount);
+            block.interactions.reserve(interactionCount);
+            int64_t lastPolicy = 0, lastTime = 0;
+            for (uint64_t i = 0; i < clientCount; i++) {
+                string_view idCard = columns[ID_CARD].str();
+                string_view firstName = word(columns[FIRST_NAME]);
+                string_view lastName = word(columns[LAST_NAME]);
+                string_view email = columns[EMAIL].str();
+                lastPolicy += unzigzag(columns[POLICY_NUMBER].varint());
+                block.clients.emplace_back(idCard, firstName, lastName, email, static_cast<int>(lastPolicy),
+                                           Company(word(columns[COMPANY])));
+                uint64_t count = columns[INTERACTION_COUNT].varint();
+                if (count > interactionCount - block.interactions.size()) return false;
+                block.interactionCounts.push_back(static_cast<uint32_t>(count));
+                for (uint64_t k = 0; k < count; k++) {
+                    string description(word(columns[DESCRIPTION]));
+                    string_view symbol = word(columns[SYMBOL]);
+                    if (columns[KIND].varint() == static_cast<uint64_t>(InteractionKind::Appointment)) {
+                        lastTime += unzigzag(columns[TIME].varint());
+                        block.interactions.emplace_back(Appointment(move(description), symbol, AppointmentTime(lastTime)));
+                    } else {
+                        block.interactions.emplace_back(Contract(move(description), columns[VALUE].real(), symbol));
+                    }
+                }
+            }
+            for (const auto& column : columns) {
+                if (!column.ok) return false;
+            }
+            return block.interactions.size() == interactionCount;
+        }
+
+    public:
+        static bool saveToCSV(const string& filename, const ClientManager& manager) {
+            Metrics::Timer timer(Metrics::SaveCsv);
+            auto startTime = chrono::steady_clock::now();
+            AtomicFileWriter writer;
+            if (!writer.open(filename)) {
+                cout << "Error: Could not open file for writing.\n";
+                return false;
+            }
+
+            writer.raw(csv::HEADER);
+            size_t rows = writeRows(writer, manager, 0, manager.getClients().size());
+
+            if (!writer.commit()) {
+                cout << "Error: Could not write " << filename << ".\n";
+                return false;
+            }
+
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            double megabytes = writer.getBytesWritten() / (1024.0 * 1024.0);
+            cout << "Data saved to " << filename << " successfully!\n";
+            stringstream stats;
+            stats << fixed << setprecision(2)
+                  << "Wrote " << rows << " rows (" << megabytes << " MB) in " << seconds << " s: "
+                  << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/s\n";
+            cout << stats.str();
+            return true;
+        }
+
+        // Writes the clients in slots [begin, end) as a file of their own,
+        // without any messages.
+        static bool saveSlotsToCSV(const string& filename, const ClientManager& manager, size_t begin, size_t end) {
+            Metrics::Timer timer(Metrics::SaveCsv);
+            AtomicFileWriter writer;
+            if (!writer.open(filename)) return false;
+            writer.raw(csv::HEADER);
+            writeRows(writer, manager, begin, end);
+            return writer.commit();
+        }
+
+        static bool saveSnapshot(const string& filename, const ClientManager& manager, bool quiet = false) {
+            Metrics::Timer timer(Metrics::SaveSnapshot);
+            auto startTime = chrono::steady_clock::now();
+            vector<char> blob;
+            vector<snapshot::ClientRecord> clientRecords;
+            vector<snapshot::InteractionRecord> interactionRecords;
+            vector<snapshot::StringRef> symbolRefs;
+
+            clientRecords.reserve(manager.clientCount());
+            const auto& clients = manager.getClients();
+            const InteractionStore& store = manager.getInteractionStore();
+            for (size_t i = 0; i < clients.size(); i++) {
+                if (!manager.isLive(static_cast<int>(i))) continue;
+                const ClientRecord& client = clients[i];
+                const auto& interactions = manager.getInteractions(static_cast<int>(i));
+
+                snapshot::ClientRecord record{};
+                record.idCard = addString(blob, client.getIdCard());
+                record.firstName = addString(blob, client.getFirstName());
+                record.lastName = addString(blob, client.getLastName());
+                record.email = addString(blob, client.getEmail());
+                record.company = addSymbol(blob, client.getCompany().getNameId(), symbolRefs);
+                record.policyNumber = client.getPolicyNumber();
+                record.interactionCount = static_cast<uint32_t>(interactions.size());
+                record.firstInteraction = interactionRecords.size();
+                clientRecords.push_back(record);
+
+                for (const auto& ref : interactions) {
+                    snapshot::InteractionRecord item{};
+                    item.kind = static_cast<uint32_t>(ref.kind);
+                    switch (ref.kind) {
+                        case InteractionKind::Appointment: {
+                            const Appointment& apt = store.appointment(ref);
+                            item.description = addString(blob, apt.getDescription());
+                            item.a = addSymbol(blob, apt.getSalesPersonId(), symbolRefs);
+                            item.time = apt.getTime().getMinutes();
+                            break;
+                        }
+                        case InteractionKind::Contract: {
+                            const Contract& contract = store.contract(ref);
+                            item.description = addString(blob, contract.getDescription());
+                            item.a = addSymbol(blob, contract.getStatusId(), symbolRefs);
+                            item.value = contract.getValue();
+                            break;
+                        }
+                    }
+                    interactionRecords.push_back(item);
+                }
+            }
+
+            snapshot::Header header{};
+            memcpy(header.magic, snapshot::MAGIC, sizeof(snapshot::MAGIC));
+            header.version = snapshot::VERSION;
+            header.headerSize = sizeof(snapshot::Header);
+            header.clientCount = clientRecords.size();
+            header.interactionCount = interactionRecords.size();
+            header.logSequence = manager.getLogSequence();
+
+            const char* sectionData[snapshot::SECTION_COUNT] = {
+                blob.data(),
+                reinterpret_cast<const char*>(clientRecords.data()),
+                reinterpret_cast<const char*>(interactionRecords.data())
+            };
+            size_t sectionSize[snapshot::SECTION_COUNT] = {
+                blob.size(),
+                clientRecords.size() * sizeof(snapshot::ClientRecord),
+                interactionRecords.size() * sizeof(snapshot::InteractionRecord)
+            };
+            // Record sections start 8-byte aligned so they can be read in place.
+            uint64_t offset = sizeof(snapshot::Header);
+            for (int i = 0; i < snapshot::SECTION_COUNT; i++) {
+                offset = (offset + 7) & ~uint64_t(7);
+                header.sections[i] = {offset, sectionSize[i], snapshot::checksum(sectionData[i], sectionSize[i])};
+                offset += sectionSize[i];
+            }
+            header.headerChecksum = snapshot::checksum(reinterpret_cast<const char*>(&header),
+                                                       offsetof(snapshot::Header, headerChecksum));
+
+            AtomicFileWriter writer;
+            if (!writer.open(filename)) {
+                if (!quiet) cout << "Error: Could not open file for writing.\n";
+                return false;
+            }
+            writer.raw(string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+            size_t written = sizeof(header);
+            for (int i = 0; i < snapshot::SECTION_COUNT; i++) {
+                while (written < header.sections[i].offset) {
+                    writer.put('\0');
+                    written++;
+                }
+                writer.raw(string_view(sectionData[i], sectionSize[i]));
+                written += sectionSize[i];
+            }
+            if (!writer.commit()) {
+                if (!quiet) cout << "Error: Could not write " << filename << ".\n";
+                return false;
+            }
+            if (quiet) return true;
+
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            stringstream stats;
+            stats << fixed << setprecision(2) << "Snapshot saved to " << filename << " ("
+                  << writer.getBytesWritten() / (1024.0 * 1024.0) << " MB in " << seconds << " s)\n";
+            cout << stats.str();
+            return true;
+        }
+
+        // A full load: checks every section's checksum, then copies each
+        // record into manager and builds its indexes at the end of the bulk
+        // load. The mapping is released on return.
+        static bool loadSnapshot(const string& filename, ClientManager& manager, bool quiet = false) {
+            Metrics::Timer timer(Metrics::LoadSnapshot);
+            auto startTime = chrono::steady_clock::now();
+            snapshot::Reader reader;
+            if (!reader.open(filename)) {
+                if (!quiet) cout << "Warning: " << filename << " is missing or not a valid snapshot.\n";
+                return false;
+            }
+            if (!reader.verify()) {
+                if (!quiet) cout << "Warning: checksum mismatch in " << filename << ".\n";
+                return false;
+            }
+
+            size_t appointmentCount = 0;
+            for (size_t j = 0; j < reader.interactionCount(); j++) {
+                if (reader.interaction(j).kind == static_cast<uint32_t>(InteractionKind::Appointment)) appointmentCount++;
+            }
+
+            manager.clear();
+            manager.setLogSequence(reader.logSequence());
+            manager.reserve(reader.clientCount(), appointmentCount, reader.interactionCount() - appointmentCount);
+            manager.beginBulkLoad();
+            for (size_t i = 0; i < reader.clientCount(); i++) {
+                const snapshot::ClientRecord& record = reader.client(i);
+                ClientView client(reader.str(record.idCard), reader.str(record.firstName), reader.str(record.lastName),
+                                  reader.str(record.email), record.policyNumber, Company(reader.str(record.company)));
+                if (!manager.addClient(client)) continue;
+
+                int slot = manager.findById(client.getIdCard());
+                uint64_t last = min<uint64_t>(record.firstInteraction + record.interactionCount, reader.interactionCount());
+                for (uint64_t j = record.firstInteraction; j < last; j++) {
+                    const snapshot::InteractionRecord& item = reader.interaction(j);
+                    string description(reader.str(item.description));
+                    if (item.kind == static_cast<uint32_t>(InteractionKind::Appointment)) {
+                        manager.addInteraction(slot, Appointment(move(description), reader.str(item.a), AppointmentTime(item.time)));
+                    } else if (item.kind == static_cast<uint32_t>(InteractionKind::Contract)) {
+                        manager.addInteraction(slot, Contract(move(description), item.value, reader.str(item.a)));
+                    }
+                }
+            }
+            manager.endBulkLoad(quiet);
+
+            if (quiet) return true;
+
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            stringstream stats;
+            stats << fixed << setprecision(2) << "Snapshot loaded from " << filename << " ("
+                  << manager.clientCount() << " clients, " << reader.interactionCount() << " interactions in "
+                  << seconds << " s)\n";
+            cout << stats.str();
+            return true;
+        }
+
+        // Writes manager as a compressed .crz file, encoding and compressing
+        // its blocks on up to threads workers while they are written in order.
+        static bool savePacked(const string& filename, const ClientManager& manager, unsigned threads = 1, bool quiet = false) {
+            Metrics::Timer timer(Metrics::SavePacked);
+            auto startTime = chrono::steady_clock::now();
+            AtomicFileWriter writer;
+            if (!writer.open(filename)) {
+                if (!quiet) cout << "Error: Could not open file for writing.\n";
+                return false;
+            }
+
+            struct EncodedBlock {
+                string data;
+                packed::BlockInfo info{};
+            };
+            size_t slots = manager.getClients().size();
+            size_t blockCount = (slots + packed::BLOCK_SLOTS - 1) / packed::BLOCK_SLOTS;
+            vector<EncodedBlock> blocks(blockCount);
+            vector<promise<void>> ready(blockCount);
+            atomic<size_t> next(0);
+            vector<thread> workers;
+            for (size_t t = 0; t < min<size_t>(threads, blockCount); t++) {
+                workers.emplace_back([&]() {
+                    string raw;
+                    for (size_t i = next++; i < blockCount; i = next++) {
+                        size_t begin = i * packed::BLOCK_SLOTS;
+                        packed::BlockInfo& info = blocks[i].info;
+                        encodeBlock(manager, begin, min(slots, begin + packed::BLOCK_SLOTS), raw, info.clients, info.interactions);
+                        packed::compress(raw.data(), raw.size(), blocks[i].data);
+                        info.rawSize = static_cast<uint32_t>(raw.size());
+                        info.compressedSize = static_cast<uint32_t>(blocks[i].data.size());
+                        info.checksum = snapshot::checksum(blocks[i].data.data(), blocks[i].data.size());
+                        ready[i].set_value();
+                    }
+                });
+            }
+
+            writer.raw(string_view(packed::MAGIC, sizeof(packed::MAGIC)));
+            uint64_t offset = sizeof(packed::MAGIC);
+            vector<packed::BlockInfo> index(blockCount);
+            packed::Trailer trailer{};
+            for (size_t i = 0; i < blockCount; i++) {
+                ready[i].get_future().wait();
+                index[i] = blocks[i].info;
+                index[i].offset = offset;
+                writer.raw(blocks[i].data);
+                offset += blocks[i].data.size();
+                trailer.clientCount += index[i].clients;
+                trailer.interactionCount += index[i].interactions;
+                trailer.rawBytes += index[i].rawSize;
+                string().swap(blocks[i].data);
+            }
+            for (auto& worker : workers) worker.join();
+
+            string_view indexBytes(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(packed::BlockInfo));
+            writer.raw(indexBytes);
+            trailer.indexOffset = offset;
+            trailer.blockCount = blockCount;
+            trailer.logSequence = manager.getLogSequence();
+            trailer.version = packed::VERSION;
+            trailer.indexChecksum = snapshot::checksum(indexBytes.data(), indexBytes.size());
+            memcpy(trailer.magic, packed::MAGIC, sizeof(packed::MAGIC));
+            trailer.trailerChecksum = snapshot::checksum(reinterpret_cast<const char*>(&trailer),
+                                                         offsetof(packed::Trailer, trailerChecksum));
+            writer.raw(string_view(reinterpret_cast<const char*>(&trailer), sizeof(trailer)));
+
+            if (!writer.commit()) {
+                if (!quiet) cout << "Error: Could not write " << filename << ".\n";
+                return false;
+            }
+            if (quiet) return true;
+
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            stringstream stats;
+            stats << fixed << setprecision(2) << "Data saved to " << filename << " (" << trailer.clientCount << " clients, "
+                  << writer.getBytesWritten() / (1024.0 * 1024.0) << " MB in " << seconds << " s)\n";
+            cout << stats.str();
+            return true;
+        }
+
+        // Blocks are decompressed and decoded on up to threads workers, at
+        // most a few blocks ahead of the one being added, so the load streams.
+        // A damaged block fails the whole load and leaves manager empty.
+        static bool loadPacked(const string& filename, ClientManager& manager, unsigned threads = 1, bool quiet = false) {
+            Metrics::Timer timer(Metrics::LoadPacked);
+            auto startTime = chrono::steady_clock::now();
+            packed::Reader reader;
+            if (!reader.open(filename)) {
+                if (!quiet) cout << "Warning: " << filename << " is missing or not a valid packed file.\n";
+                return false;
+            }
+
+            size_t blockCount = reader.blockCount();
+            size_t window = 2 * static_cast<size_t>(threads);
+            vector<PackedBlock> blocks(blockCount);
+            vector<char> decoded(blockCount, false);
+            vector<promise<void>> ready(blockCount);
+            mutex lock;
+            condition_variable progress;
+            size_t applied = 0;
+            atomic<size_t> next(0);
+            vector<thread> workers;
+            for (size_t t = 0; t < min<size_t>(threads, blockCount); t++) {
+                workers.emplace_back([&]() {
+                    for (size_t i = next++; i < blockCount; i = next++) {
+                        {
+                            unique_lock<mutex> guard(lock);
+                            progress.wait(guard, [&] { return i < applied + window; });
+                        }
+                        decoded[i] = decodeBlock(reader, i, blocks[i]);
+                        ready[i].set_value();
+                    }
+                });
+            }
+
+            manager.clear();
+            manager.setLogSequence(reader.logSequence());
+            manager.reserve(reader.clientCount());
+            manager.beginBulkLoad();
+            bool ok = true;
+            for (size_t i = 0; i < blockCount; i++) {
+                ready[i].get_future().wait();
+                PackedBlock& block = blocks[i];
+                if (!decoded[i]) {
+                    if (ok && !quiet) cout << "Warning: block " << i << " of " << filename << " is damaged.\n";
+                    ok = false;
+                }
+                if (ok) {
+                    for (size_t c = 0, k = 0; c < block.clients.size(); c++) {
+                        int slot = manager.addClient(block.clients[c]) ? static_cast<int>(manager.getClients().size() - 1) : -1;
+                        for (uint32_t j = 0; j < block.interactionCounts[c]; j++, k++) {
+                            if (slot >= 0) visit([&](auto& item) { manager.addInteraction(slot, move(item)); }, block.interactions[k]);
+                        }
+                    }
+                }
+                blocks[i] = PackedBlock();
+                {
+                    lock_guard<mutex> guard(lock);
+                    applied = i + 1;
+                }
+                progress.notify_all();
+            }
+            for (auto& worker : workers) worker.join();
+            manager.endBulkLoad(quiet);
+            if (!ok) {
+                manager.clear();
+                return false;
+            }
+            if (quiet) return true;
+
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            stringstream stats;
+            stats << fixed << setprecision(2) << "Data loaded from " << filename << " (" << manager.clientCount() << " clients, "
+                  << reader.interactionCount() << " interactions, " << reader.size() / (1024.0 * 1024.0) << " MB in "
+                  << seconds << " s)\n";
+            cout << stats.str();
+            return true;
+        }
+
+        // Log sequence recorded in a packed file's trailer; false if there is
+        // no valid one.
+        static bool packedSequence(const string& filename, uint64_t& sequence) {
+            packed::Reader reader;
+            if (!reader.open(filename)) return false;
+            sequence = reader.logSequence();
+            return true;
+        }
+
+        // Log sequence recorded in a snapshot's header; false if there is no
+        // valid snapshot.
+        static bool snapshotSequence(const string& filename, uint64_t& sequence) {
+            snapshot::Reader reader;
+            if (!reader.open(filename)) return false;
+            sequence = reader.logSequence();
+            return true;
+        }
+
+        // Adds the rows of filename to manager without clearing it or printing
+        // anything; the caller brackets a series of these with
+        // beginBulkLoad()/endBulkLoad(). False if the file cannot be read or
+        // has an appointment without a valid time.
+        static bool appendFromCSV(const string& filename, ClientManager& manager, unsigned threads = 1) {
+            Metrics::Timer timer(Metrics::LoadCsv);
+            InvalidTimes invalid;
+            if (threads > 1) {
+                vector<char> data;
+                if (!readWholeFile(filename, data)) return false;
+                if (data.size() >= PARALLEL_MIN_BYTES) {
+                    csv::Layout layout;
+                    bool known;
+                    size_t begin = readHeader(data, layout, known);
+                    loadParallel(data, begin, layout, manager, threads, invalid);
+                    return invalid.count == 0;
+                }
+            }
+
+            CsvReader reader;
+            if (!reader.open(filename)) return false;
+            vector<string_view> fields;
+            reader.nextRecord(fields);
+            csv::Layout layout;
+            layout.readHeader(fields);
+            loadSequential(reader, layout, manager, invalid);
+            return invalid.count == 0;
+        }
+
+        // crm_data.csv -> crm_data.rejects.csv
+        static string rejectsFilename(const string& filename) {
+            size_t dot = filename.rfind('.');
+            size_t slash = filename.rfind('/');
+            bool extension = dot != string::npos && (slash == string::npos || dot > slash);
+            return (extension ? filename.substr(0, dot) : filename) + ".rejects.csv";
+        }
+
+        static bool writeRejects(const string& filename, const InvalidTimes& invalid) {
+            AtomicFileWriter writer;
+            if (!writer.open(filename)) return false;
+            writer.raw(csv::HEADER);
+            for (const auto& record : invalid.records) {
+                for (size_t c = 0; c < record.size(); c++) {
+                    if (c > 0) writer.put(',');
+                    writer.field(record[c]);
+                }
+                writer.put('\n');
+            }
+            return writer.commit();
+        }
+
+        // Writes the appointments without a valid date or hour, as CSV rows,
+        // to a rejects file next to filename, where they can be corrected and
+        // loaded again; everything else in the file is loaded. If they cannot
+        // be written the whole load is rejected instead, leaving manager
+        // empty, since the next save would lose them.
+        static bool setAsideInvalidTimes(const string& filename, ClientManager& manager, const InvalidTimes& invalid) {
+            string rejects = rejectsFilename(filename);
+            bool written = writeRejects(rejects, invalid);
+            cout << (written ? "Warning: " : "Error: ") << invalid.count << " appointment(s) in " << filename
+                 << " have an invalid date or hour (expected YYYY-MM-DD and HH:MM):\n" << invalid.listing;
+            if (invalid.count > InvalidTimes::LISTED) cout << "  ... and " << invalid.count - InvalidTimes::LISTED << " more\n";
+            if (written) {
+                cout << "They were not loaded; their rows are kept in " << rejects << ".\n";
+                return true;
+            }
+            manager.clear();
+            manager.endBulkLoad(true);
+            cout << "Could not write " << rejects << ". Nothing was loaded. Correct these rows and load again.\n";
+            return false;
+        }
+
+        // threads > 1 parses newline-aligned chunks concurrently; the result is
+        // identical to the sequential load (first occurrence of an ID wins,
+        // interactions keep file order). Columns are matched to the schema by
+        // the names in the header row, so they may come in any order.
+        // Appointments with an unparsable time go to a rejects file (see
+        // setAsideInvalidTimes()). If that fails, or no row makes a client,
+        // the load is rejected: manager is left empty and *rejected is set.
+        static bool loadFromCSV(const string& filename, ClientManager& manager, unsigned threads = 1,
+                                bool* rejected = nullptr) {
+            Metrics::Timer timer(Metrics::LoadCsv);
+            auto startTime = chrono::steady_clock::now();
+            InvalidTimes invalid;
+            if (rejected) *rejected = false;
+
+            if (threads > 1) {
+                vector<char> data;
+                if (!readWholeFile(filename, data)) {
+                    cout << "Warning: Could not open file " << filename << ". Starting with empty database.\n";
+                    return false;
+                }
+                if (data.size() >= PARALLEL_MIN_BYTES) {
+                    csv::Layout layout;
+                    bool known;
+                    size_t begin = readHeader(data, layout, known);
+                    if (!known) warnUnknownHeader(filename);
+
+                    manager.clear();
+                    manager.beginBulkLoad();
+                    size_t rows = loadParallel(data, begin, layout, manager, threads, invalid);
+                    if (rows > 0 && manager.clientCount() == 0) {
+                        if (rejected) *rejected = true;
+                        return rejectEmptyLoad(filename, manager, rows);
+                    }
+                    if (invalid.count > 0 && !setAsideInvalidTimes(filename, manager, invalid)) {
+                        if (rejected) *rejected = true;
+                        return false;
+                    }
+                    manager.endBulkLoad();
+                    reportLoad(filename, manager, rows, data.size(), startTime);
+                    return true;
+                }
+            }
+
+            CsvReader reader;
+            if (!reader.open(filename)) {
+                cout << "Warning: Could not open file " << filename << ". Starting with empty database.\n";
+                return false;
+            }
+
+            vector<string_view> fields;
+            reader.nextRecord(fields);
+            csv::Layout layout;
+            if (!layout.readHeader(fields) && !fields.empty()) warnUnknownHeader(filename);
+
+            manager.clear();
+            manager.beginBulkLoad();
+            size_t rows = loadSequential(reader, layout, manager, invalid);
+            if (rows > 0 && manager.clientCount() == 0) {
+                if (rejected) *rejected = true;
+                return rejectEmptyLoad(filename, manager, rows);
+            }
+            if (invalid.count > 0 && !setAsideInvalidTimes(filename, manager, invalid)) {
+                if (rejected) *rejected = true;
+                return false;
+            }
+            manager.endBulkLoad();
+            reportLoad(filename, manager, rows, reader.getBytesRead(), startTime);
+            return true;
+        }
+
+};
+
+class SegmentStore {
+    // Saves clients as a directory of CSV segment files, each holding a
+    // contiguous range of slots, plus a MANIFEST listing them in order. A save
+    // rewrites only the segments with dirty slots, under new names so the
+    // manifest switches over atomically, and keeps every other file as it is.
+    // Slots added since the last save fill up the last segment, then new ones.
+    // A rewritten segment that has shrunk is merged with its successor. The
+    // segments concatenated are an ordinary crm_data.csv (see exportTo()).
+    public:
+        static const size_t SEGMENT_SLOTS = 1 << 14;
+
+    private:
+        struct Segment {
+            string file;
+            size_t start;    // first slot, in the manager's current numbering
+            size_t clients;  // clients in the file
+        };
+
+        struct Manifest {
+            uint64_t sequence = 0;
+            uint64_t nextFile = 1;
+            vector<Segment> segments;
+        };
+
+        string directory;
+        Manifest layout;
+        size_t coveredSlots = 0;
+        // Generation of the slots the layout describes; 0 when detached.
+        // Captures share their manager's, so they save incrementally too.
+        uint64_t attachedGeneration = 0;
+
+        string manifestPath() const { return directory + "/MANIFEST"; }
+        string pathOf(const string& file) const { return directory + "/" + file; }
+
+        // Segment starts are the running client counts, which is where a
+        // fresh load of the files puts them.
+        bool readManifest(Manifest& manifest) const {
+            ifstream in(manifestPath());
+            string magic, key;
+            int version = 0;
+            if (!(in >> magic >> version) || magic != "crm-segments" || version != 1) return false;
+            if (!(in >> key >> manifest.sequence) || key != "sequence") return false;
+            if (!(in >> key >> manifest.nextFile) || key != "next") return false;
+            string file;
+            size_t count, start = 0;
+            while (in >> file >> count) {
+                manifest.segments.push_back(Segment{file, start, count});
+                start += count;
+            }
+            return in.eof();
+        }
+
+        bool writeManifest() const {
+            AtomicFileWriter writer;
+            if (!writer.open(manifestPath())) return false;
+            writer.raw("crm-segments 1\nsequence ");
+            writer.integer(static_cast<long long>(layout.sequence));
+            writer.raw("\nnext ");
+            writer.integer(static_cast<long long>(layout.nextFile));
+            writer.put('\n');
+            for (const auto& segment : layout.segments) {
+                writer.raw(segment.file);
+                writer.put(' ');
+                writer.integer(static_cast<long long>(segment.clients));
+                writer.put('\n');
+            }
+            return writer.commit();
+        }
+
+        bool isAttached(const ClientManager& manager) const {
+            return attachedGeneration == manager.getGeneration();
+        }
+
+        void attach(ClientManager& manager) {
+            attachedGeneration = manager.getGeneration();
+            coveredSlots = manager.getClients().size();
+            manager.markClean();
+        }
+
+        size_t endOf(size_t i) const {
+            return i + 1 < layout.segments.size() ? layout.segments[i + 1].start : coveredSlots;
+        }
+
+        static size_t liveIn(const ClientManager& manager, size_t begin, size_t end) {
+            size_t count = 0;
+            for (size_t slot = begin; slot < end; slot++) count += manager.isLive(static_cast<int>(slot));
+            return count;
+        }
+
+        size_t segmentOf(size_t slot) const {
+            auto it = upper_bound(layout.segments.begin(), layout.segments.end(), slot,
+                                  [](size_t value, const Segment& segment) { return value < segment.start; });
+            return static_cast<size_t>(it - layout.segments.begin()) - 1;
+        }
+
+        // Drops the unsaved layout: the next save writes everything afresh.
+        void fail(const vector<string>& created) {
+            for (const auto& file : created) ::unlink(pathOf(file).c_str());
+            layout = Manifest();
+            attachedGeneration = 0;
+        }
+
+    public:
+        explicit SegmentStore(string dir) : directory(move(dir)) {}
+
+        const string& getDirectory() const { return directory; }
+
+        // Log sequence of the saved segments; false if there are none.
+        bool savedSequence(uint64_t& sequence) const {
+            Manifest manifest;
+            if (!readManifest(manifest)) return false;
+            sequence = manifest.sequence;
+            return true;
+        }
+
+        // Modification time of the manifest, i.e. of the last save.
+        bool savedTime(struct stat& info) const { return stat(manifestPath().c_str(), &info) == 0; }
+
+        bool load(ClientManager& manager, unsigned threads = 1) {
+            auto startTime = chrono::steady_clock::now();
+            Manifest manifest;
+            if (!readManifest(manifest)) return false;
+
+            manager.clear();
+            manager.beginBulkLoad();
+            for (auto& segment : manifest.segments) {
+                segment.start = manager.getClients().size();
+                if (!FileManager::appendFromCSV(pathOf(segment.file), manager, threads)) {
+                    manager.endBulkLoad(true);
+                    cout << "Warning: segment " << pathOf(segment.file) << " is missing or damaged.\n";
+                    return false;
+                }
+                segment.clients = manager.getClients().size() - segment.start;
+            }
+            manager.endBulkLoad();
+            manager.setLogSequence(manifest.sequence);
+            layout = manifest;
+            attach(manager);
+
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            stringstream stats;
+            stats << fixed << setprecision(2) << "Data loaded from " << directory << " (" << manager.clientCount()
+                  << " clients in " << layout.segments.size() << " segment(s), " << seconds << " s)\n";
+            cout << stats.str();
+            return true;
+        }
+
+        // For a manager just loaded from a snapshot of the very state the
+        // segments hold: its slots are the segments' clients in order, so the
+        // layout carries over and the next save stays incremental.
+        bool adopt(ClientManager& manager) {
+            Manifest manifest;
+            if (!readManifest(manifest) || manifest.sequence != manager.getLogSequence()) return false;
+            size_t total = manifest.segments.empty() ? 0 : manifest.segments.back().start + manifest.segments.back().clients;
+            if (total != manager.getClients().size()) return false;
+            layout = manifest;
+            attach(manager);
+            return true;
+        }
+
+        bool save(ClientManager& manager, bool quiet = false) {
+            auto startTime = chrono::steady_clock::now();
+            ::mkdir(directory.c_str(), 0755);
+            vector<string> obsolete, created;
+            if (!isAttached(manager)) {
+                Manifest previous;
+                if (readManifest(previous)) {
+                    for (const auto& segment : previous.segments) obsolete.push_back(segment.file);
+                    layout.nextFile = previous.nextFile;
+                }
+                layout.segments.clear();
+                coveredSlots = 0;
+            }
+
+            auto& segments = layout.segments;
+            vector<bool> rewrite(segments.size(), false);
+            for (int slot : manager.getDirtySlots()) {
+                if (static_cast<size_t>(slot) < coveredSlots) rewrite[segmentOf(static_cast<size_t>(slot))] = true;
+            }
+            size_t slotCount = manager.getClients().size();
+            if (slotCount > coveredSlots || segments.empty()) {
+                size_t next = 0;
+                if (!segments.empty()) {
+                    next = max(coveredSlots, segments.back().start + SEGMENT_SLOTS);
+                    if (next > coveredSlots) rewrite.back() = true;
+                }
+                do {
+                    segments.push_back(Segment{"", next, 0});
+                    rewrite.push_back(true);
+                    next += SEGMENT_SLOTS;
+                } while (next < slotCount);
+                coveredSlots = slotCount;
+            }
+
+            for (size_t i = 0; i + 1 < segments.size();) {
+                bool merge = (rewrite[i] || rewrite[i + 1]) &&
+                             liveIn(manager, segments[i].start, endOf(i + 1)) <= SEGMENT_SLOTS;
+                if (!merge) {
+                    i++;
+                    continue;
+                }
+                if (!segments[i + 1].file.empty()) obsolete.push_back(segments[i + 1].file);
+                segments.erase(segments.begin() + static_cast<long>(i) + 1);
+                rewrite.erase(rewrite.begin() + static_cast<long>(i) + 1);
+                rewrite[i] = true;
+            }
+
+            size_t rewritten = 0;
+            for (size_t i = 0; i < segments.size(); i++) {
+                if (!rewrite[i]) continue;
+                char name[32];
+                snprintf(name, sizeof(name), "seg-%06llu.csv", static_cast<unsigned long long>(layout.nextFile++));
+                if (!FileManager::saveSlotsToCSV(pathOf(name), manager, segments[i].start, endOf(i))) {
+                    cout << "Error: Could not write " << pathOf(name) << ".\n";
+                    fail(created);
+                    return false;
+                }
+                created.push_back(name);
+                if (!segments[i].file.empty()) obsolete.push_back(segments[i].file);
+                segments[i].file = name;
+                segments[i].clients = liveIn(manager, segments[i].start, endOf(i));
+                rewritten++;
+            }
+
+            layout.sequence = manager.getLogSequence();
+            if (!writeManifest()) {
+                cout << "Error: Could not write " << manifestPath() << ".\n";
+                fail(created);
+                return false;
+            }
+            for (const auto& file : obsolete) ::unlink(pathOf(file).c_str());
+            attach(manager);
+            if (quiet) return true;
+
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            stringstream stats;
+            stats << fixed << setprecision(3) << "Data saved to " << directory << " (" << rewritten << " of "
+                  << segments.size() << " segment(s) rewritten in " << seconds << " s)\n";
+            cout << stats.str();
+            return true;
+        }
+
+        // Concatenates the saved segments into one CSV for the regular loader.
+        bool exportTo(const string& filename) const {
+            Manifest manifest;
+            if (!readManifest(manifest)) {
+                cout << "Error: no saved segments in " << directory << ".\n";
+                return false;
+            }
+            AtomicFileWriter writer;
+            if (!writer.open(filename)) {
+                cout << "Error: Could not open file for writing.\n";
+                return false;
+            }
+            writer.raw(csv::HEADER);
+            string data;
+            for (const auto& segment : manifest.segments) {
+                ifstream in(pathOf(segment.file), ios::binary);
+                if (!in.is_open()) {
+                    cout << "Error: segment " << pathOf(segment.file) << " is missing.\n";
+                    return false;
+                }
+                data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+                size_t body = data.find('\n');
+                if (body != string::npos) writer.raw(string_view(data).substr(body + 1));
+            }
+            if (!writer.commit()) {
+                cout << "Error: Could not write " << filename << ".\n";
+                return false;
+            }
+            cout << "Exported " << manifest.segments.size() << " segment(s) to " << filename << "\n";
+            return true;
+        }
+};
+
+class DatasetGenerator {
+    // Writes synthetic crm_data.csv files for benchmarking. Everything is
+    // derived from a splitmix64 stream rather than <random> distributions
+    // (which differ between standard libraries), so a given spec, seed
+    // included, always produces a byte-identical file.
+    public:
+        struct Spec {
+            size_t clients = 100000;
+            double interactionsPerClient = 2.0;  // mean of a geometric distribution
+            size_t firstNames = 500;
+            size_t lastNames = 5000;
+            size_t companies = 10000;
+            size_t salesPeople = 50;
+            uint64_t seed = 1;
+        };
+
+    private:
+        static const size_t MAX_INTERACTIONS = 64;
+
+        Spec spec;
+        uint64_t state;
+        size_t rows = 0;
+        size_t interactionCount = 0;
+
+        uint64_t next() {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        size_t below(size_t n) { return n > 0 ? static_cast<size_t>(next() % n) : 0; }
+        double unit() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+        // Distinct k give distinct names: every syllable has two letters and
+        // the last one is never "ma" unless the name is a single syllable.
+        static string syllableName(size_t k) {
+            static const char* const SYLLABLES[] = {"ma", "ri", "lo", "an", "te", "sa", "vi", "no", "be", "ca",
+                                                    "do", "el", "fi", "gi", "lu", "pa", "ro", "si", "ta", "zo"};
+            string name;
+            do {
+                name += SYLLABLES[k % 20];
+                k /= 20;
+            } while (k > 0);
+            name[0] = static_cast<char>(toupper(static_cast<unsigned char>(name[0])));
+            return name;
+        }
+
+        static string lowercase(string text) {
+            for (char& c : text) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            return text;
+        }
+
+        static string companyName(size_t k) {
+            static const char* const SUFFIXES[] = {"S.p.A.", "S.r.l.", "Assicurazioni", "& Partners", "Group, Ltd"};
+            return syllableName(k + 8000) + " " + SUFFIXES[k % 5];
+        }
+
+        // Skewed towards low numbers: a few large accounts, a long tail of small ones.
+        size_t pickCompany() {
+            double u = unit();
+            return static_cast<size_t>(u * u * static_cast<double>(spec.companies));
+        }
+
+        size_t pickInteractionCount() {
+            double keepGoing = spec.interactionsPerClient / (spec.interactionsPerClient + 1.0);
+            size_t count = 0;
+            while (count < MAX_INTERACTIONS && unit() < keepGoing) count++;
+            return count;
+        }
+
+        void writeAppointment(AtomicFileWriter& writer, const ClientView& client, int64_t firstDay) {
+            static const char* const DESCRIPTIONS[] = {"Policy review", "Renewal meeting", "Claim follow-up",
+                                                       "First consultation", "Quote for \"premium\" plan, family"};
+            size_t salesPerson = below(spec.salesPeople);
+            int64_t minutes = (firstDay + static_cast<int64_t>(below(APPOINTMENT_DAYS))) * AppointmentTime::MINUTES_PER_DAY +
+                              static_cast<int64_t>(8 * 60 + below(20) * 30);
+            // Now and then a multi-line note, as typed into a spreadsheet cell.
+            string description = below(1000) == 0 ? "Call back\nafter lunch" : DESCRIPTIONS[below(5)];
+            Appointment appointment(move(description), salesPersonName(salesPerson), AppointmentTime(minutes));
+            csv::formatRow(writer, client, appointment);
+        }
+
+        void writeContract(AtomicFileWriter& writer, const ClientView& client) {
+            static const char* const DESCRIPTIONS[] = {"Auto insurance", "Home insurance", "Life insurance",
+                                                       "Health plan", "Fleet cover, 12 vehicles"};
+            static const char* const STATUSES[] = {"Signed", "Signed", "Signed", "Signed", "Signed",
+                                                   "Pending", "Pending", "Pending", "Cancelled", "Cancelled"};
+            double u = unit();
+            long long cents = 20000 + static_cast<long long>(u * u * u * 5000000.0);
+            string description = DESCRIPTIONS[below(5)];
+            csv::formatRow(writer, client, Contract(move(description), static_cast<double>(cents) / 100.0, STATUSES[below(10)]));
+        }
+
+    public:
+        explicit DatasetGenerator(const Spec& spec) : spec(spec), state(spec.seed) {}
+
+        // Name number k; at least two syllables, so names look like names.
+        static string firstName(size_t k) { return syllableName(k + 20); }
+        static string lastName(size_t k) { return syllableName(k + 400); }
+        static string salesPersonName(size_t k) { return firstName(k * 7) + " " + lastName(k * 31); }
+
+        // Appointments fall on APPOINTMENT_DAYS days from firstAppointmentDay(),
+        // at half-hour slots between 8:00 and 17:30.
+        static const int64_t APPOINTMENT_DAYS = 730;
+        static int64_t firstAppointmentDay() {
+            int64_t day = 0;
+            AppointmentTime::parseDate("2024-01-01", day);
+            return day;
+        }
+
+        bool write(const string& filename) {
+            static const char* const DOMAINS[] = {"example.com", "mail.test", "insura.test", "corp.example"};
+            auto startTime = chrono::steady_clock::now();
+            AtomicFileWriter writer;
+            if (!writer.open(filename)) {
+                cout << "Error: Could not open file for writing.\n";
+                return false;
+            }
+            writer.raw(csv::HEADER);
+
+            int64_t firstDay = firstAppointmentDay();
+            state = spec.seed;
+            rows = interactionCount = 0;
+            for (size_t i = 0; i < spec.clients; i++) {
+                string first = firstName(below(spec.firstNames));
+                string last = lastName(below(spec.lastNames));
+                string company = companyName(pickCompany());
+                char id[24];
+                snprintf(id, sizeof(id), "C%09zu", i);
+                string email = lowercase(first) + "." + lowercase(last) + to_string(i) + "@" + DOMAINS[i % 4];
+                ClientView client(id, first, last, email, static_cast<int>(1000000 + i), Company(company));
+
+                size_t count = pickInteractionCount();
+                if (count == 0) {
+                    csv::formatRow(writer, client, monostate());
+                    rows++;
+                }
+                for (size_t k = 0; k < count; k++) {
+                    // Roughly two appointments for every contract.
+                    if (below(3) < 2) {
+                        writeAppointment(writer, client, firstDay);
+                    } else {
+                        writeContract(writer, client);
+                    }
+                    rows++;
+                }
+                interactionCount += count;
+            }
+
+            if (!writer.commit()) {
+                cout << "Error: Could not write " << filename << ".\n";
+                return false;
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+            stringstream stats;
+            stats << fixed << setprecision(2) << "Generated " << spec.clients << " clients, " << interactionCount
+                  << " interactions (" << rows << " rows, " << writer.getBytesWritten() / (1024.0 * 1024.0)
+                  << " MB) in " << seconds << " s\n";
+            cout << stats.str();
+            return true;
+        }
+
+        size_t getRows() const { return rows; }
+        size_t getInteractionCount() const { return interactionCount; }
+};
+
+class WriteAheadLog : public ChangeLog {
+    // Appends every ClientManager mutation as a checksummed record:
+    //   uint32 payload length | uint64 checksum | payload
+    // where the payload starts with the sequence number and the operation.
+    // Records are buffered and a flusher thread writes and fdatasyncs them in
+    // groups, so a crash loses at most one sync interval of changes.
+    public:
+        enum Operation : uint8_t {
+            ADD_CLIENT = 1,
+            UPDATE_CLIENT = 2,
+            DELETE_CLIENT = 3,
+            ADD_APPOINTMENT = 4,
+            ADD_CONTRACT = 5
+        };
+
+        // Logs larger than this are folded into the snapshot in the background.
+        static const size_t COMPACTION_BYTES = 64 << 20;
+        // Base sequence of a log that no snapshot is the base of.
+        static constexpr uint64_t NO_BASE = UINT64_MAX;
+
+    private:
+        static const size_t GROUP_BYTES = 1 << 20;
+
+        string path;
+        int fd = -1;
+        chrono::milliseconds syncInterval;
+
+        mutex lock;
+        condition_variable wake;
+        condition_variable synced;
+        vector<char> pending;
+        vector<char> record;
+        uint64_t sequence = 0;
+        uint64_t durableSequence = 0;
+        size_t fileSize = 0;
+        bool syncRequested = false;
+        bool stopping = false;
+        bool failed = false;
+        // Sequence of the snapshot this log's records apply to; compaction
+        // only folds the log into a snapshot that is exactly that base.
+        atomic<uint64_t> baseSequence{NO_BASE};
+        thread flusher;
+        thread compactor;
+
+        static void putU32(vector<char>& out, uint32_t value) {
+            out.insert(out.end(), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + 4);
+        }
+
+        static void putU64(vector<char>& out, uint64_t value) {
+            out.insert(out.end(), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + 8);
+        }
+
+        static void putString(vector<char>& out, string_view text) {
+            putU32(out, static_cast<uint32_t>(text.size()));
+            out.insert(out.end(), text.begin(), text.end());
+        }
+
+        static void putClient(vector<char>& out, const ClientView& client) {
+            putString(out, client.getIdCard());
+            putString(out, client.getFirstName());
+            putString(out, client.getLastName());
+            putString(out, client.getEmail());
+            putU32(out, static_cast<uint32_t>(client.getPolicyNumber()));
+            putString(out, client.getCompany().getName());
+        }
+
+        // Reads fields back out of one record payload.
+        class Cursor {
+            private:
+                const char* data;
+                size_t size;
+                size_t pos = 0;
+
+            public:
+                bool ok = true;
+
+                Cursor(const char* d, size_t n) : data(d), size(n) {}
+
+                bool done() const { return pos == size; }
+
+                uint64_t u64() {
+                    uint64_t value = 0;
+                    if (size - pos < 8) { ok = false; return 0; }
+                    memcpy(&value, data + pos, 8);
+                    pos += 8;
+                    return value;
+                }
+
+                uint32_t u32() {
+                    uint32_t value = 0;
+                    if (size - pos < 4) { ok = false; return 0; }
+                    memcpy(&value, data + pos, 4);
+                    pos += 4;
+                    return value;
+                }
+
+                uint8_t u8() {
+                    if (pos >= size) { ok = false; return 0; }
+                    return static_cast<uint8_t>(data[pos++]);
+                }
+
+                string str() {
+                    uint32_t length = u32();
+                    if (!ok || size - pos < length) { ok = false; return string(); }
+                    string value(data + pos, length);
+                    pos += length;
+                    return value;
+                }
+
+                Client client() {
+                    Client value;
+                    value.setIdCard(str());
+                    value.setFirstName(str());
+                    value.setLastName(str());
+                    value.setEmail(str());
+                    value.setPolicyNumber(static_cast<int32_t>(u32()));
+                    value.setCompany(Company(str()));
+                    return value;
+                }
+        };
+
+        void beginRecord(Operation op) {
+            record.clear();
+            putU32(record, 0);
+            putU64(record, 0);
+            putU64(record, sequence + 1);
+            record.push_back(static_cast<char>(op));
+        }
+
+        uint64_t commitRecord() {
+            uint32_t length = static_cast<uint32_t>(record.size() - 12);
+            uint64_t sum = snapshot::checksum(record.data() + 12, length);
+            memcpy(record.data(), &length, 4);
+            memcpy(record.data() + 4, &sum, 8);
+
+            lock_guard<mutex> guard(lock);
+            pending.insert(pending.end(), record.begin(), record.end());
+            sequence++;
+            if (pending.size() >= GROUP_BYTES) wake.notify_one();
+            return sequence;
+        }
+
+        void flushLoop() {
+            unique_lock<mutex> guard(lock);
+            vector<char> writing;
+            while (true) {
+                wake.wait_for(guard, syncInterval, [this]() {
+                    return stopping || syncRequested || pending.size() >= GROUP_BYTES;
+                });
+                if (!pending.empty()) {
+                    writing.swap(pending);
+                    uint64_t batchSequence = sequence;
+                    guard.unlock();
+
+                    bool ok = true;
+                    size_t done = 0;
+                    while (done < writing.size()) {
+                        ssize_t n = ::write(fd, writing.data() + done, writing.size() - done);
+                        if (n < 0) {
+                            ok = false;
+                            break;
+                        }
+                        done += static_cast<size_t>(n);
+                    }
+                    if (ok && ::fdatasync(fd) != 0) ok = false;
+
+                    guard.lock();
+                    fileSize += done;
+                    if (ok) durableSequence = batchSequence;
+                    else failed = true;
+                    writing.clear();
+                }
+                syncRequested = false;
+                synced.notify_all();
+                if (stopping && pending.empty()) break;
+            }
+        }
+
+        // Applies one record; false if it is malformed.
+        static bool apply(Cursor& in, uint8_t op, ClientManager& manager) {
+            switch (op) {
+                case ADD_CLIENT: {
+                    Client client = in.client();
+                    if (!in.ok) return false;
+                    if (manager.findById(client.getIdCard()) < 0) manager.addClient(client);
+                    break;
+                }
+                case UPDATE_CLIENT: {
+                    string oldId = in.str();
+                    Client client = in.client();
+                    if (!in.ok) return false;
+                    int index = manager.findById(oldId);
+                    if (index >= 0) manager.updateClient(index, client);
+                    break;
+                }
+                case DELETE_CLIENT: {
+                    string clientId = in.str();
+                    if (!in.ok) return false;
+                    int index = manager.findById(clientId);
+                    if (index >= 0) manager.removeClient(index);
+                    break;
+                }
+                case ADD_APPOINTMENT: {
+                    string clientId = in.str();
+                    string desc = in.str();
+                    string salesPerson = in.str();
+                    string date = in.str();
+                    string hour = in.str();
+                    if (!in.ok) return false;
+                    int index = manager.findById(clientId);
+                    AppointmentTime when;
+                    if (index >= 0 && AppointmentTime::parse(date, hour, when)) {
+                        manager.addInteraction(index, Appointment(move(desc), salesPerson, when), Booking::Unchecked);
+                    }
+                    break;
+                }
+                case ADD_CONTRACT: {
+                    string clientId = in.str();
+                    string desc = in.str();
+                    uint64_t bits = in.u64();
+                    string status = in.str();
+                    if (!in.ok) return false;
+                    double value;
+                    memcpy(&value, &bits, 8);
+                    int index = manager.findById(clientId);
+                    if (index >= 0) manager.addInteraction(index, Contract(move(desc), value, status));
+                    break;
+                }
+                default:
+                    return false;
+            }
+            return in.done();
+        }
+
+    public:
+        explicit WriteAheadLog(const string& filename, chrono::milliseconds interval = chrono::milliseconds(50))
+            : path(filename), syncInterval(interval) {}
+
+        WriteAheadLog(const WriteAheadLog&) = delete;
+        WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+        ~WriteAheadLog() {
+            close();
+        }
+
+        const string& getPath() const { return path; }
+        string sealedPath() const { return path + ".old"; }
+
+        // Applies the records of a log file newer than the manager's sequence.
+        // A torn or corrupt tail ends the replay; returns the number of bytes
+        // that were valid, so the caller can cut the tail off.
+        static size_t replay(const string& filename, ClientManager& manager, size_t& applied) {
+            applied = 0;
+            ifstream file(filename, ios::binary | ios::ate);
+            if (!file.is_open()) return 0;
+            vector<char> data(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), static_cast<streamsize>(data.size()));
+
+            size_t pos = 0;
+            while (data.size() - pos >= 12) {
+                uint32_t length;
+                uint64_t sum;
+                memcpy(&length, data.data() + pos, 4);
+                memcpy(&sum, data.data() + pos + 4, 8);
+                if (data.size() - pos - 12 < length) break;
+                const char* payload = data.data() + pos + 12;
+                if (snapshot::checksum(payload, length) != sum) break;
+
+                Cursor in(payload, length);
+                uint64_t recordSequence = in.u64();
+                uint8_t op = in.u8();
+                if (!in.ok) break;
+                if (recordSequence > manager.getLogSequence()) {
+                    if (!apply(in, op, manager)) break;
+                    manager.setLogSequence(recordSequence);
+                    applied++;
+                }
+                pos += 12 + length;
+            }
+            return pos;
+        }
+
+        // Opens the log for appending after a replay, cutting off any torn
+        // tail, and continues numbering after sequence. base is the sequence
+        // of the snapshot the log applies to, or NO_BASE if the snapshot is
+        // not its base (then the log is never compacted).
+        bool open(size_t validBytes, uint64_t lastSequence, uint64_t base) {
+            baseSequence = base;
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd < 0) return false;
+            if (::ftruncate(fd, static_cast<off_t>(validBytes)) != 0) return false;
+            // A freshly created log must be found again after a crash.
+            if (!AtomicFileWriter::syncDirectory(path)) return false;
+            fileSize = validBytes;
+            sequence = durableSequence = lastSequence;
+            stopping = false;
+            failed = false;
+            flusher = thread(&WriteAheadLog::flushLoop, this);
+            return true;
+        }
+
+        // Blocks until every record appended so far is on disk.
+        bool sync() {
+            unique_lock<mutex> guard(lock);
+            if (fd < 0) return false;
+            uint64_t target = sequence;
+            while (durableSequence < target && !failed) {
+                syncRequested = true;
+                wake.notify_one();
+                synced.wait(guard);
+            }
+            return !failed;
+        }
+
+        // Empties the log once its records are part of a saved base file.
+        void reset() {
+            sync();
+            lock_guard<mutex> guard(lock);
+            if (fd >= 0 && ::ftruncate(fd, 0) == 0) fileSize = 0;
+            ::unlink(sealedPath().c_str());
+        }
+
+        void close() {
+            waitForCompaction();
+            if (fd < 0) return;
+            {
+                lock_guard<mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_one();
+            flusher.join();
+            ::close(fd);
+            fd = -1;
+        }
+
+        bool needsCompaction() {
+            lock_guard<mutex> guard(lock);
+            return fileSize + pending.size() >= COMPACTION_BYTES && !compactor.joinable();
+        }
+
+        // Seals the current log and folds it into snapshotFile on a background
+        // thread, working on a private ClientManager. Appends continue in a
+        // fresh log meanwhile. On failure the sealed log stays for replay.
+        void startCompaction(const string& snapshotFile) {
+            uint64_t expected = baseSequence;
+            if (expected == NO_BASE || compactor.joinable() || access(sealedPath().c_str(), F_OK) == 0) return;
+            if (!sync()) return;
+            {
+                lock_guard<mutex> guard(lock);
+                if (::rename(path.c_str(), sealedPath().c_str()) != 0) return;
+                int next = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+                if (next < 0) {
+                    ::rename(sealedPath().c_str(), path.c_str());
+                    return;
+                }
+                ::close(fd);
+                fd = next;
+                fileSize = 0;
+                AtomicFileWriter::syncDirectory(path);
+            }
+
+            // A missing snapshot is the empty base, sequence 0. Any other
+            // mismatch would fold the log onto the wrong data, so the sealed
+            // log is left for the next load to replay instead.
+            string sealed = sealedPath();
+            compactor = thread([this, snapshotFile, sealed, expected]() {
+                ClientManager base;
+                struct stat info;
+                if (stat(snapshotFile.c_str(), &info) == 0 && !FileManager::loadSnapshot(snapshotFile, base, true)) return;
+                if (base.getLogSequence() != expected) return;
+                size_t applied = 0;
+                WriteAheadLog::replay(sealed, base, applied);
+                if (FileManager::saveSnapshot(snapshotFile, base, true)) {
+                    baseSequence = base.getLogSequence();
+                    ::unlink(sealed.c_str());
+                }
+            });
+        }
+
+        void waitForCompaction() {
+            if (compactor.joinable()) compactor.join();
+        }
+
+        uint64_t clientAdded(const ClientView& client) override {
+            beginRecord(ADD_CLIENT);
+            putClient(record, client);
+            return commitRecord();
+        }
+
+        uint64_t clientUpdated(string_view oldId, const ClientView& client) override {
+            beginRecord(UPDATE_CLIENT);
+            putString(record, oldId);
+            putClient(record, client);
+            return commitRecord();
+        }
+
+        uint64_t clientDeleted(string_view clientId) override {
+            beginRecord(DELETE_CLIENT);
+            putString(record, clientId);
+            return commitRecord();
+        }
+
+        uint64_t interactionAdded(string_view clientId, const Interaction& interaction) override {
+            switch (interaction.getKind()) {
+                case InteractionKind::Appointment: {
+                    const Appointment& apt = static_cast<const Appointment&>(interaction);
+                    beginRecord(ADD_APPOINTMENT);
+                    putString(record, clientId);
+                    putString(record, apt.getDescription());
+                    putString(record, apt.getSalesPerson());
+                    putString(record, apt.getDate());
+                    putString(record, apt.getHour());
+                    break;
+                }
+                case InteractionKind::Contract: {
+                    const Contract& contract = static_cast<const Contract&>(interaction);
+                    double value = contract.getValue();
+                    uint64_t bits;
+                    memcpy(&bits, &value, 8);
+                    beginRecord(ADD_CONTRACT);
+                    putString(record, clientId);
+                    putString(record, contract.getDescription());
+                    putU64(record, bits);
+                    putString(record, contract.getStatus());
+                    break;
+                }
+            }
+            return commitRecord();
+        }
+};
+
+class Deduplicator {
+    // Finds clients entered more than once and merges each group into its
+    // earliest record. Every client gets up to three blocking keys (its
+    // normalized email, a phonetic code of its name and its policy number),
+    // and the (key, slot) entries are sorted so that only clients sharing a
+    // key are ever compared: every pair within a small block, neighbours in
+    // name order within a large one. That keeps the whole job O(n log n).
+    // Keys, sorting and scoring are split across threads; the merges then go
+    // through ClientManager one by one, so they are logged like any edit.
+    public:
+        enum Reason : uint8_t {
+            SAME_EMAIL = 1,
+            SAME_EMAIL_USER = 2,
+            SAME_POLICY = 4,
+            SIMILAR_NAME = 8,
+            SAME_COMPANY = 16
+        };
+
+        struct Merge {
+            string keptId;
+            string mergedId;
+            // Of the best match that put mergedId in the group.
+            double score;
+            uint8_t reasons;
+        };
+
+        struct Report {
+            size_t clients = 0;
+            size_t blockingKeys = 0;
+            size_t largeBlocks = 0;
+            size_t candidatePairs = 0;
+            size_t matches = 0;
+            size_t groups = 0;
+            size_t movedInteractions = 0;
+            bool applied = false;
+            double keySeconds = 0;
+            double pairSeconds = 0;
+            double scoreSeconds = 0;
+            double mergeSeconds = 0;
+            // Ordered by kept client, then by merged client.
+            vector<Merge> merges;
+        };
+
+        static constexpr double DEFAULT_THRESHOLD = 0.75;
+
+    private:
+        struct Entry {
+            uint64_t key;
+            uint32_t slot;
+
+            bool operator<(const Entry& other) const {
+                return key != other.key ? key < other.key : slot < other.slot;
+            }
+        };
+
+        struct Match {
+            uint32_t keep;
+            uint32_t duplicate;
+            float score;
+            uint8_t reasons;
+        };
+
+        enum KeyKind : uint64_t { EMAIL_KEY = 1, NAME_KEY = 2, POLICY_KEY = 3 };
+
+        static constexpr uint32_t NO_SLOT = UINT32_MAX;
+        // Blocks up to this size are compared pair by pair; larger ones only
+        // within a window of neighbours.
+        static constexpr size_t MAX_BLOCK = 32;
+        static constexpr size_t WINDOW = 8;
+        static constexpr size_t MAX_NAME = 64;
+        static const size_t MIN_ITEMS_PER_THREAD = 1 << 16;
+
+        // Score weights; a full-weight name match counts NAME_WEIGHT.
+        static constexpr float EMAIL_WEIGHT = 0.4f;
+        static constexpr float EMAIL_USER_WEIGHT = 0.25f;
+        static constexpr float POLICY_WEIGHT = 0.4f;
+        static constexpr float NAME_WEIGHT = 0.4f;
+        static constexpr float COMPANY_WEIGHT = 0.1f;
+        static constexpr double SIMILAR_NAME_LEVEL = 0.85;
+
+        // Runs work(part) for part in [0, parts), one part per thread.
+        template <typename Work>
+        static void runParts(size_t parts, Work work) {
+            vector<thread> workers;
+            for (size_t p = 1; p < parts; p++) workers.emplace_back([&, p] { work(p); });
+            if (parts > 0) work(0);
+            for (auto& worker : workers) worker.join();
+        }
+
+        static size_t partCount(size_t items, unsigned threads) {
+            return max<size_t>(1, min<size_t>(threads, items / MIN_ITEMS_PER_THREAD));
+        }
+
+        // Sorts contiguous runs on separate threads, then merges neighbouring
+        // runs pairwise, each round's merges again in parallel.
+        template <typename T>
+        static void parallelSort(vector<T>& items, unsigned threads) {
+            size_t parts = partCount(items.size(), threads);
+            size_t step = (items.size() + parts - 1) / parts;
+            vector<size_t> bounds;
+            for (size_t p = 0; p <= parts; p++) bounds.push_back(min(items.size(), p * step));
+            runParts(parts, [&](size_t p) { sort(items.begin() + bounds[p], items.begin() + bounds[p + 1]); });
+            while (bounds.size() > 2) {
+                runParts((bounds.size() - 1) / 2, [&](size_t p) {
+                    inplace_merge(items.begin() + bounds[2 * p], items.begin() + bounds[2 * p + 1],
+                                  items.begin() + bounds[2 * p + 2]);
+                });
+                vector<size_t> merged;
+                for (size_t i = 0; i < bounds.size(); i += 2) merged.push_back(bounds[i]);
+                if (merged.back() != bounds.back()) merged.push_back(bounds.back());
+                bounds = move(merged);
+            }
+        }
+
+        static double since(chrono::steady_clock::time_point start) {
+            return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+
+        static char lower(char c) {
+            return static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        }
+
+        // Lowercased, with any "+tag" dropped from the local part; Gmail also
+        // ignores dots there. Empty when email has no '@'.
+        static void normalizeEmail(string_view email, string& out) {
+            out.clear();
+            while (!email.empty() && isspace(static_cast<unsigned char>(email.front()))) email.remove_prefix(1);
+            while (!email.empty() && isspace(static_cast<unsigned char>(email.back()))) email.remove_suffix(1);
+            size_t at = email.rfind('@');
+            if (at == string_view::npos || at == 0 || at + 1 == email.size()) return;
+            string_view domain = email.substr(at + 1);
+            auto sameDomain = [&](string_view name) {
+                return domain.size() == name.size() &&
+                       equal(domain.begin(), domain.end(), name.begin(), [](char a, char b) { return lower(a) == b; });
+            };
+            bool gmail = sameDomain("gmail.com") || sameDomain("googlemail.com");
+            for (char c : email.substr(0, at)) {
+                if (c == '+') break;
+                if (gmail && c == '.') continue;
+                out.push_back(lower(c));
+            }
+            out.push_back('@');
+            if (gmail) {
+                out.append("gmail.com");
+            } else {
+                for (char c : domain) out.push_back(lower(c));
+            }
+        }
+
+        // Soundex without the cut to four characters: the first letter, then
+        // one digit per run of similar-sounding consonants.
+        static void appendPhonetic(string_view name, string& out) {
+            static const char CODES[] = "01230120022455012623010202";
+            char last = 0;
+            bool first = true;
+            for (char c : name) {
+                if (!isalpha(static_cast<unsigned char>(c))) continue;
+                c = lower(c);
+                char code = CODES[c - 'a'];
+                if (first) {
+                    out.push_back(c);
+                    first = false;
+                } else if (code != '0' && code != last) {
+                    out.push_back(code);
                 }
-                case 5: {
-                    cout << "Enter new Policy Number: ";
-                    cin >> choice;
-                    client.setPolicyNumber(choice);
+                if (c != 'h' && c != 'w') last = code;
+            }
+        }
+
+        // The letters of name, lowercased, at most MAX_NAME of them.
+        static string_view fold(string_view name, char* buffer) {
+            size_t length = 0;
+            for (char c : name) {
+                if (length == MAX_NAME) break;
+                if (isalpha(static_cast<unsigned char>(c))) buffer[length++] = lower(c);
+            }
+            return string_view(buffer, length);
+        }
+
+        static double jaroWinkler(string_view a, string_view b) {
+            if (a.empty() || b.empty()) return a.empty() && b.empty() ? 1.0 : 0.0;
+            if (a == b) return 1.0;
+            size_t range = max(a.size(), b.size()) / 2;
+            range = range > 0 ? range - 1 : 0;
+            bool usedA[MAX_NAME] = {};
+            bool usedB[MAX_NAME] = {};
+            size_t matches = 0;
+            for (size_t i = 0; i < a.size(); i++) {
+                size_t from = i > range ? i - range : 0;
+                size_t to = min(b.size(), i + range + 1);
+                for (size_t j = from; j < to; j++) {
+                    if (usedB[j] || a[i] != b[j]) continue;
+                    usedA[i] = usedB[j] = true;
+                    matches++;
                     break;
                 }
-                case 6: {
-                    cout << "Enter new Company Name: ";
-                    getline(cin, input);
-                    Company newCompany;
-                    newCompany.setName(input);
-                    client.setCompany(newCompany);
-                    break;
+            }
+            if (matches == 0) return 0.0;
+            size_t transpositions = 0;
+            for (size_t i = 0, j = 0; i < a.size(); i++) {
+                if (!usedA[i]) continue;
+                while (!usedB[j]) j++;
+                if (a[i] != b[j]) transpositions++;
+                j++;
+            }
+            double m = static_cast<double>(matches);
+            double jaro = (m / a.size() + m / b.size() + (m - transpositions / 2.0) / m) / 3.0;
+            size_t prefix = 0;
+            while (prefix < 4 && prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix]) prefix++;
+            return jaro + prefix * 0.1 * (1.0 - jaro);
+        }
+
+        // Average similarity of first and last names, also tried the other
+        // way round for records with the two swapped.
+        static double nameSimilarity(const ClientRecord& a, const ClientRecord& b) {
+            char buffers[4][MAX_NAME];
+            string_view firstA = fold(a.getFirstName(), buffers[0]);
+            string_view lastA = fold(a.getLastName(), buffers[1]);
+            string_view firstB = fold(b.getFirstName(), buffers[2]);
+            string_view lastB = fold(b.getLastName(), buffers[3]);
+            double straight = (jaroWinkler(firstA, firstB) + jaroWinkler(lastA, lastB)) / 2.0;
+            if (straight == 1.0) return straight;
+            double swapped = (jaroWinkler(firstA, lastB) + jaroWinkler(lastA, firstB)) / 2.0;
+            return max(straight, swapped);
+        }
+
+        // emailA and emailB are scratch buffers, kept by the caller so that
+        // scoring does not allocate per pair.
+        static float score(const ClientRecord& a, const ClientRecord& b, uint8_t& reasons,
+                           string& emailA, string& emailB) {
+            float total = 0;
+            reasons = 0;
+            normalizeEmail(a.getEmail(), emailA);
+            normalizeEmail(b.getEmail(), emailB);
+            if (!emailA.empty() && emailA == emailB) {
+                total += EMAIL_WEIGHT;
+                reasons |= SAME_EMAIL;
+            } else if (!emailA.empty() && !emailB.empty()) {
+                string_view userA = string_view(emailA).substr(0, emailA.find('@'));
+                string_view userB = string_view(emailB).substr(0, emailB.find('@'));
+                if (userA.size() >= 3 && userA == userB) {
+                    total += EMAIL_USER_WEIGHT;
+                    reasons |= SAME_EMAIL_USER;
                 }
-                default:
-                    cout << "Invalid choice.\n";
+            }
+            if (a.getPolicyNumber() == b.getPolicyNumber()) {
+                total += POLICY_WEIGHT;
+                reasons |= SAME_POLICY;
+            }
+            double name = nameSimilarity(a, b);
+            total += NAME_WEIGHT * static_cast<float>(name);
+            if (name >= SIMILAR_NAME_LEVEL) reasons |= SIMILAR_NAME;
+            if (a.getCompany().getNameId() == b.getCompany().getNameId()) {
+                total += COMPANY_WEIGHT;
+                reasons |= SAME_COMPANY;
+            }
+            return min(total, 1.0f);
+        }
+
+        // Three entries per slot, in slot order; keys a client lacks (or all
+        // three, for deleted slots) are left with NO_SLOT and dropped after.
+        static vector<Entry> blockingKeys(const ClientManager& manager, unsigned threads) {
+            const auto& clients = manager.getClients();
+            vector<Entry> entries(clients.size() * 3, Entry{0, NO_SLOT});
+            size_t parts = partCount(clients.size(), threads);
+            size_t step = (clients.size() + parts - 1) / parts;
+            runParts(parts, [&](size_t p) {
+                string text;
+                for (size_t i = p * step; i < min(clients.size(), (p + 1) * step); i++) {
+                    if (!manager.isLive(static_cast<int>(i))) continue;
+                    const ClientRecord& client = clients[i];
+                    uint32_t slot = static_cast<uint32_t>(i);
+                    normalizeEmail(client.getEmail(), text);
+                    if (!text.empty()) entries[3 * i] = {hashKey(text) ^ EMAIL_KEY, slot};
+                    text.clear();
+                    appendPhonetic(client.getLastName(), text);
+                    text.push_back('|');
+                    appendPhonetic(client.getFirstName(), text);
+                    if (text.size() > 1) entries[3 * i + 1] = {hashKey(text) ^ NAME_KEY, slot};
+                    entries[3 * i + 2] = {hashKey(client.getPolicyNumber()) ^ POLICY_KEY, slot};
+                }
+            });
+            entries.erase(remove_if(entries.begin(), entries.end(), [](const Entry& e) { return e.slot == NO_SLOT; }),
+                          entries.end());
+            return entries;
+        }
+
+        static uint64_t pairKey(uint32_t a, uint32_t b) {
+            return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+        }
+
+        // Candidate pairs from the sorted entries, each pair once, ascending.
+        static vector<uint64_t> candidatePairs(const ClientManager& manager, const vector<Entry>& entries,
+                                               unsigned threads, size_t& largeBlocks) {
+            const auto& clients = manager.getClients();
+            size_t parts = partCount(entries.size(), threads);
+            // Part boundaries are moved forward to the start of a block.
+            vector<size_t> bounds{0};
+            for (size_t p = 1; p < parts; p++) {
+                size_t start = max(bounds.back(), entries.size() * p / parts);
+                while (start > 0 && start < entries.size() && entries[start].key == entries[start - 1].key) start++;
+                bounds.push_back(start);
+            }
+            bounds.push_back(entries.size());
+            vector<vector<uint64_t>> found(parts);
+            vector<size_t> large(parts, 0);
+            runParts(parts, [&](size_t p) {
+                vector<pair<string, uint32_t>> ordered;
+                char buffers[2][MAX_NAME];
+                for (size_t begin = bounds[p], end; begin < bounds[p + 1]; begin = end) {
+                    end = begin + 1;
+                    while (end < bounds[p + 1] && entries[end].key == entries[begin].key) end++;
+                    if (end - begin <= MAX_BLOCK) {
+                        for (size_t i = begin; i < end; i++) {
+                            for (size_t j = i + 1; j < end; j++) found[p].push_back(pairKey(entries[i].slot, entries[j].slot));
+                        }
+                        continue;
+                    }
+                    // Sorted neighbourhood: near neighbours by name are the
+                    // likeliest duplicates in a block too big to compare fully.
+                    large[p]++;
+                    ordered.clear();
+                    for (size_t i = begin; i < end; i++) {
+                        const ClientRecord& client = clients[entries[i].slot];
+                        string sortKey(fold(client.getLastName(), buffers[0]));
+                        sortKey.push_back(' ');
+                        sortKey.append(fold(client.getFirstName(), buffers[1]));
+                        ordered.emplace_back(move(sortKey), entries[i].slot);
+                    }
+                    sort(ordered.begin(), ordered.end());
+                    for (size_t i = 0; i < ordered.size(); i++) {
+                        for (size_t j = i + 1; j < min(ordered.size(), i + WINDOW); j++) {
+                            found[p].push_back(pairKey(ordered[i].second, ordered[j].second));
+                        }
+                    }
+                }
+            });
+            vector<uint64_t> pairs;
+            size_t total = 0;
+            for (const auto& part : found) total += part.size();
+            pairs.reserve(total);
+            for (auto& part : found) {
+                pairs.insert(pairs.end(), part.begin(), part.end());
+                vector<uint64_t>().swap(part);
+            }
+            for (size_t count : large) largeBlocks += count;
+            parallelSort(pairs, threads);
+            pairs.erase(unique(pairs.begin(), pairs.end()), pairs.end());
+            return pairs;
+        }
+
+        static vector<Match> scorePairs(const ClientManager& manager, const vector<uint64_t>& pairs,
+                                        unsigned threads, double threshold) {
+            const auto& clients = manager.getClients();
+            size_t parts = partCount(pairs.size(), threads);
+            vector<vector<Match>> found(parts);
+            runParts(parts, [&](size_t p) {
+                string emailA, emailB;
+                for (size_t i = pairs.size() * p / parts; i < pairs.size() * (p + 1) / parts; i++) {
+                    uint32_t a = static_cast<uint32_t>(pairs[i] >> 32);
+                    uint32_t b = static_cast<uint32_t>(pairs[i]);
+                    uint8_t reasons;
+                    float value = score(clients[a], clients[b], reasons, emailA, emailB);
+                    if (value >= threshold) found[p].push_back({a, b, value, reasons});
+                }
+            });
+            vector<Match> matches;
+            for (auto& part : found) matches.insert(matches.end(), part.begin(), part.end());
+            return matches;
+        }
+
+        static uint32_t findRoot(vector<uint32_t>& parent, uint32_t slot) {
+            while (parent[slot] != slot) {
+                parent[slot] = parent[parent[slot]];
+                slot = parent[slot];
+            }
+            return slot;
+        }
+
+        static string describe(uint8_t reasons) {
+            static const char* const NAMES[] = {"email", "email user", "policy", "name", "company"};
+            string text;
+            for (int bit = 0; bit < 5; bit++) {
+                if (!(reasons & (1 << bit))) continue;
+                if (!text.empty()) text.push_back('+');
+                text.append(NAMES[bit]);
+            }
+            return text;
+        }
+
+    public:
+        // Finds duplicate groups among the live clients; with apply, merges
+        // each group into its lowest slot. Matches scoring below threshold
+        // are ignored.
+        static Report run(ClientManager& manager, unsigned threads, bool apply,
+                          double threshold = DEFAULT_THRESHOLD) {
+            Report report;
+            report.clients = manager.clientCount();
+            threads = max(1u, threads);
+
+            auto start = chrono::steady_clock::now();
+            vector<Entry> entries = blockingKeys(manager, threads);
+            report.blockingKeys = entries.size();
+            parallelSort(entries, threads);
+            report.keySeconds = since(start);
+
+            start = chrono::steady_clock::now();
+            vector<uint64_t> pairs = candidatePairs(manager, entries, threads, report.largeBlocks);
+            vector<Entry>().swap(entries);
+            report.candidatePairs = pairs.size();
+            report.pairSeconds = since(start);
+
+            start = chrono::steady_clock::now();
+            vector<Match> matches = scorePairs(manager, pairs, threads, threshold);
+            vector<uint64_t>().swap(pairs);
+            report.matches = matches.size();
+            report.scoreSeconds = since(start);
+
+            // Groups are the connected components of the matches; each is
+            // rooted at its lowest slot, the client that is kept.
+            start = chrono::steady_clock::now();
+            vector<uint32_t> involved;
+            for (const auto& match : matches) {
+                involved.push_back(match.keep);
+                involved.push_back(match.duplicate);
+            }
+            sort(involved.begin(), involved.end());
+            involved.erase(unique(involved.begin(), involved.end()), involved.end());
+            auto position = [&](uint32_t slot) {
+                return static_cast<size_t>(lower_bound(involved.begin(), involved.end(), slot) - involved.begin());
+            };
+            vector<uint32_t> parent(involved.size());
+            for (uint32_t i = 0; i < parent.size(); i++) parent[i] = i;
+            vector<Match> best(involved.size(), Match{0, 0, 0.0f, 0});
+            for (const auto& match : matches) {
+                size_t a = position(match.keep);
+                size_t b = position(match.duplicate);
+                uint32_t rootA = findRoot(parent, static_cast<uint32_t>(a));
+                uint32_t rootB = findRoot(parent, static_cast<uint32_t>(b));
+                if (rootA != rootB) parent[max(rootA, rootB)] = min(rootA, rootB);
+                for (size_t end : {a, b}) {
+                    if (match.score > best[end].score) best[end] = match;
+                }
+            }
+            vector<pair<uint32_t, uint32_t>> merges;
+            for (uint32_t i = 0; i < involved.size(); i++) {
+                uint32_t root = findRoot(parent, i);
+                if (root == i) report.groups++;
+                else merges.emplace_back(root, i);
+            }
+            sort(merges.begin(), merges.end());
+            const auto& clients = manager.getClients();
+            for (const auto& [root, member] : merges) {
+                report.merges.push_back({string(clients[involved[root]].getIdCard()),
+                                         string(clients[involved[member]].getIdCard()),
+                                         best[member].score, best[member].reasons});
+            }
+            if (apply) {
+                for (const auto& [root, member] : merges) {
+                    int keep = static_cast<int>(involved[root]);
+                    int duplicate = static_cast<int>(involved[member]);
+                    size_t moved = manager.getInteractions(duplicate).size();
+                    if (manager.mergeClients(keep, duplicate)) report.movedInteractions += moved;
+                }
+                report.applied = true;
+            }
+            report.mergeSeconds = since(start);
+            return report;
+        }
+
+        static string summary(const Report& report) {
+            stringstream out;
+            out << fixed << setprecision(2)
+                << "Deduplication: " << report.clients << " clients, " << report.blockingKeys << " blocking keys, "
+                << report.candidatePairs << " candidate pairs (" << report.largeBlocks << " large blocks windowed).\n"
+                << report.matches << " matches; " << report.merges.size() << " duplicate(s) in " << report.groups
+                << " group(s) " << (report.applied ? "merged" : "found, not merged");
+            if (report.applied) out << ", " << report.movedInteractions << " interaction(s) moved";
+            out << ".\nTimes: keys " << report.keySeconds << " s, pairs " << report.pairSeconds << " s, scoring "
+                << report.scoreSeconds << " s, merging " << report.mergeSeconds << " s.\n";
+            return out.str();
+        }
+
+        // One line per merged client: who it was folded into and why.
+        static bool writeReport(const string& filename, const Report& report) {
+            AtomicFileWriter writer;
+            if (!writer.open(filename)) {
+                cout << "Error: Could not open file for writing.\n";
+                return false;
+            }
+            writer.raw("Kept ID,Merged ID,Score,Reasons\n");
+            for (const auto& merge : report.merges) {
+                writer.field(merge.keptId);
+                writer.put(',');
+                writer.field(merge.mergedId);
+                writer.put(',');
+                writer.fixed2(merge.score);
+                writer.put(',');
+                writer.field(describe(merge.reasons));
+                writer.put('\n');
+            }
+            if (!writer.commit()) {
+                cout << "Error: Could not write " << filename << ".\n";
+                return false;
+            }
+            return true;
+        }
+};
+
+class CommandProcessor {
+    // Applies scripted commands to a ClientManager without any prompts. Each
+    // command is one CSV record (RFC 4180 quoting), the verb first:
+    //   add,<id>,<first name>,<last name>,<email>,<policy>,<company>
+    //   edit,<id>,<id|first|last|email|policy|company>,<new value>
+    //   delete,<id>
+    //   appointment,<id>,<description>,<salesperson>,<YYYY-MM-DD>,<HH:MM>
+    //   contract,<id>,<description>,<value>,<status>
+    //   get,<id>
+    //   search,<name>
+    //   fuzzy,<text>[,<count>]
+    //   list,<offset>,<count>[,<slot|name|id|policy>]
+    //   report
+    //   stats
+    //   export,<file>
+    //   dedup,<dry|apply>[,<report file>]
+    // Results are appended to an output buffer as CSV records:
+    //   client,<id>,<first>,<last>,<email>,<policy>,<company>
+    //   total,<count>,<sum>,<average>
+    //   status,<name>,<count>,<sum>,<average>
+    //   stats,<Metrics JSON, quoted>
+    //   summary,<dedup summary, quoted>
+    //   dedup,<candidate pairs>,<duplicates>,<groups>,<interactions moved>
+    // dedup and export use up to threads worker threads. A processor over a
+    // const manager only runs the verbs isReadOnly() accepts.
+    private:
+        const ClientManager& manager;
+        ClientManager* writable;
+        unsigned threads;
+        string output;
+        string lastError;
+        size_t applied = 0;
+        size_t failed = 0;
+        size_t mutations = 0;
+
+        bool fail(string message) {
+            lastError = move(message);
+            failed++;
+            return false;
+        }
+
+        bool expect(const vector<string_view>& fields, size_t count) {
+            if (fields.size() == count) return true;
+            return fail(string(fields[0]) + " expects " + to_string(count - 1) + " argument(s)");
+        }
+
+        bool mutated(bool ok) {
+            if (ok) mutations++;
+            return ok;
+        }
+
+        static bool parseInt(string_view text, int& value) {
+            auto result = from_chars(text.data(), text.data() + text.size(), value);
+            return !text.empty() && result.ec == errc() && result.ptr == text.data() + text.size();
+        }
+
+        static bool parseDouble(string_view text, double& value) {
+            auto result = from_chars(text.data(), text.data() + text.size(), value);
+            return !text.empty() && result.ec == errc() && result.ptr == text.data() + text.size();
+        }
+
+        static void appendField(string& out, string_view text) {
+            if (text.find_first_of(",\"\r\n") == string_view::npos) {
+                out.append(text);
+                return;
+            }
+            out.push_back('"');
+            for (char c : text) {
+                if (c == '"') out.push_back('"');
+                out.push_back(c);
+            }
+            out.push_back('"');
+        }
+
+        void appendMoney(double value) {
+            char text[64];
+            output.append(text, static_cast<size_t>(to_chars(text, text + sizeof(text), value, chars_format::fixed, 2).ptr - text));
+        }
+
+        void printClient(int slot) {
+            const ClientRecord& client = manager.getClients()[slot];
+            output.append("client,");
+            appendField(output, client.getIdCard());
+            output.push_back(',');
+            appendField(output, client.getFirstName());
+            output.push_back(',');
+            appendField(output, client.getLastName());
+            output.push_back(',');
+            appendField(output, client.getEmail());
+            output.push_back(',');
+            output.append(to_string(client.getPolicyNumber()));
+            output.push_back(',');
+            appendField(output, client.getCompany().getName());
+            output.push_back('\n');
+        }
+
+        void printReport() {
+            const InteractionStore& store = manager.getInteractionStore();
+            Reports::Totals totals = Reports::contractTotals(store);
+            output.append("total,").append(to_string(totals.count)).push_back(',');
+            appendMoney(totals.sum);
+            output.push_back(',');
+            appendMoney(totals.average());
+            output.push_back('\n');
+            for (const auto& group : Reports::contractsByStatus(store)) {
+                output.append("status,");
+                appendField(output, group.key);
+                output.append(",").append(to_string(group.count)).push_back(',');
+                appendMoney(group.sum);
+                output.push_back(',');
+                appendMoney(group.average());
+                output.push_back('\n');
+            }
+        }
+
+        int findClient(string_view clientId) {
+            int slot = manager.findById(clientId);
+            if (slot < 0) fail("client " + string(clientId) + " not found");
+            return slot;
+        }
+
+        // Reports ID, email and policy number clashes with clients other than
+        // slot here, so the manager's own checks are only a backstop.
+        bool checkKeys(const Client& client, int slot) {
+            int owner = manager.findById(client.getIdCard());
+            if (owner >= 0 && owner != slot) return fail("client " + client.getIdCard() + " already exists");
+            owner = manager.findByEmail(client.getEmail());
+            if (owner >= 0 && owner != slot) return fail("email " + client.getEmail() + " is already in use");
+            owner = manager.findByPolicyNumber(client.getPolicyNumber());
+            if (owner >= 0 && owner != slot) return fail("policy number " + to_string(client.getPolicyNumber()) + " is already in use");
+            return true;
+        }
+
+        bool editField(Client& client, string_view field, string_view value) {
+            if (field == "id") client.setIdCard(string(value));
+            else if (field == "first") client.setFirstName(string(value));
+            else if (field == "last") client.setLastName(string(value));
+            else if (field == "email") client.setEmail(string(value));
+            else if (field == "company") client.setCompany(Company(value));
+            else if (field == "policy") {
+                int policyNumber;
+                if (!parseInt(value, policyNumber)) return fail("invalid policy number '" + string(value) + "'");
+                client.setPolicyNumber(policyNumber);
+            } else {
+                return fail("unknown field '" + string(field) + "'");
+            }
+            return true;
+        }
+
+        bool dispatch(const vector<string_view>& fields) {
+            string_view verb = fields[0];
+            if (!writable && !isReadOnly(verb)) return fail(string(verb) + " cannot change data here");
+            if (verb == "add") {
+                if (!expect(fields, 7)) return false;
+                int policyNumber;
+                if (!parseInt(fields[5], policyNumber)) return fail("invalid policy number '" + string(fields[5]) + "'");
+                Client client{string(fields[1]), string(fields[2]), string(fields[3]), string(fields[4]),
+                              policyNumber, Company(fields[6])};
+                if (!checkKeys(client, -1)) return false;
+                return mutated(writable->addClient(client)) || fail("add rejected");
+            }
+            if (verb == "edit") {
+                if (!expect(fields, 4)) return false;
+                int slot = findClient(fields[1]);
+                if (slot < 0) return false;
+                Client client = manager.getClients()[slot].toClient();
+                if (!editField(client, fields[2], fields[3]) || !checkKeys(client, slot)) return false;
+                return mutated(writable->updateClient(slot, client)) || fail("edit rejected");
+            }
+            if (verb == "delete") {
+                if (!expect(fields, 2)) return false;
+                int slot = findClient(fields[1]);
+                return slot >= 0 && mutated(writable->removeClient(slot));
+            }
+            if (verb == "appointment") {
+                if (!expect(fields, 6)) return false;
+                int slot = findClient(fields[1]);
+                if (slot < 0) return false;
+                AppointmentTime when;
+                if (!AppointmentTime::parse(fields[4], fields[5], when)) {
+                    return fail("invalid date/time '" + string(fields[4]) + " " + string(fields[5]) + "'");
+                }
+                // Checked here too so the reason reaches the caller, not the console.
+                if (!manager.getInteractionStore().conflicts(fields[3], when).empty()) {
+                    return fail(string(fields[3]) + " is already booked at " + when.date() + " " + when.hour());
+                }
+                return mutated(writable->addInteraction(slot, Appointment(string(fields[2]), fields[3], when))) || fail("appointment rejected");
+            }
+            if (verb == "contract") {
+                if (!expect(fields, 5)) return false;
+                int slot = findClient(fields[1]);
+                if (slot < 0) return false;
+                double value;
+                if (!parseDouble(fields[3], value)) return fail("invalid contract value '" + string(fields[3]) + "'");
+                return mutated(writable->addInteraction(slot, Contract(string(fields[2]), value, fields[4])));
+            }
+            if (verb == "get") {
+                if (!expect(fields, 2)) return false;
+                int slot = findClient(fields[1]);
+                if (slot < 0) return false;
+                printClient(slot);
+                return true;
+            }
+            if (verb == "search") {
+                if (!expect(fields, 2)) return false;
+                for (int slot : manager.searchClients(string(fields[1]))) printClient(slot);
+                return true;
+            }
+            if (verb == "fuzzy") {
+                if (fields.size() != 2 && !expect(fields, 3)) return false;
+                int count = 10;
+                if (fields.size() == 3 && (!parseInt(fields[2], count) || count < 0)) {
+                    return fail("invalid count '" + string(fields[2]) + "'");
+                }
+                for (const auto& match : manager.fuzzySearch(string(fields[1]), static_cast<size_t>(count))) {
+                    printClient(match.slot);
+                }
+                return true;
+            }
+            if (verb == "list") {
+                if (fields.size() != 3 && !expect(fields, 4)) return false;
+                int offset, count;
+                if (!parseInt(fields[1], offset) || offset < 0) return fail("invalid offset '" + string(fields[1]) + "'");
+                if (!parseInt(fields[2], count) || count < 0) return fail("invalid count '" + string(fields[2]) + "'");
+                ClientOrder order = ClientOrder::Slot;
+                if (fields.size() == 4) {
+                    if (fields[3] == "name") order = ClientOrder::Name;
+                    else if (fields[3] == "id") order = ClientOrder::IdCard;
+                    else if (fields[3] == "policy") order = ClientOrder::PolicyNumber;
+                    else if (fields[3] != "slot") return fail("unknown order '" + string(fields[3]) + "'");
+                }
+                for (int slot : manager.listClients(order, static_cast<size_t>(offset), static_cast<size_t>(count))) {
+                    printClient(slot);
+                }
+                return true;
+            }
+            if (verb == "report") {
+                if (!expect(fields, 1)) return false;
+                printReport();
+                return true;
+            }
+            if (verb == "stats") {
+                if (!expect(fields, 1)) return false;
+                output.append("stats,");
+                appendField(output, Metrics::toJson(Metrics::snapshot()));
+                output.push_back('\n');
+                return true;
+            }
+            if (verb == "dedup") {
+                if (fields.size() != 2 && !expect(fields, 3)) return false;
+                if (fields[1] != "apply" && fields[1] != "dry") return fail("unknown mode '" + string(fields[1]) + "'");
+                auto report = Deduplicator::run(*writable, threads, fields[1] == "apply");
+                output.append("summary,");
+                appendField(output, Deduplicator::summary(report));
+                output.push_back('\n');
+                if (fields.size() == 3 && !Deduplicator::writeReport(string(fields[2]), report)) {
+                    return fail("could not write " + string(fields[2]));
+                }
+                output.append("dedup,").append(to_string(report.candidatePairs)).push_back(',');
+                output.append(to_string(report.merges.size())).push_back(',');
+                output.append(to_string(report.groups)).push_back(',');
+                output.append(to_string(report.movedInteractions)).push_back('\n');
+                if (report.applied && !report.merges.empty()) mutated(true);
+                return true;
+            }
+            if (verb == "export") {
+                if (!expect(fields, 2)) return false;
+                string filename(fields[1]);
+                bool saved = packed::isPackedFile(filename)
+                    ? FileManager::savePacked(filename, manager, threads)
+                    : FileManager::saveToCSV(filename, manager);
+                return saved || fail("export failed");
+            }
+            return fail("unknown command '" + string(verb) + "'");
+        }
+
+    public:
+        explicit CommandProcessor(ClientManager& mgr, unsigned workerThreads = 1)
+            : manager(mgr), writable(&mgr), threads(max(1u, workerThreads)) {}
+
+        explicit CommandProcessor(const ClientManager& mgr, unsigned workerThreads = 1)
+            : manager(mgr), writable(nullptr), threads(max(1u, workerThreads)) {}
+
+        // Verbs that never change data (export only writes a file).
+        static bool isReadOnly(string_view verb) {
+            static const string_view READERS[] = {"get", "search", "fuzzy", "list", "report", "stats", "export"};
+            return find(begin(READERS), end(READERS), verb) != end(READERS);
+        }
+
+        // Blank records and records starting with '#' are skipped.
+        static bool isCommand(const vector<string_view>& fields) {
+            if (fields.size() == 1 && fields[0].empty()) return false;
+            return fields[0].empty() || fields[0][0] != '#';
+        }
+
+        // Runs one command; on failure getLastError() says why.
+        bool execute(const vector<string_view>& fields) {
+            bool ok = dispatch(fields);
+            if (ok) applied++;
+            return ok;
+        }
+
+        // Executes every command in filename ("-" reads standard input),
+        // printing results and "line N: error" for failed commands.
+        bool run(const string& filename) {
+            CsvReader reader;
+            if (!reader.open(filename == "-" ? "/dev/stdin" : filename)) {
+                cout << "Error: Could not open command file " << filename << ".\n";
+                return false;
+            }
+            vector<string_view> fields;
+            size_t nextLine = 1;
+            while (reader.nextRecord(fields)) {
+                size_t line = nextLine;
+                nextLine++;
+                for (string_view field : fields) nextLine += static_cast<size_t>(count(field.begin(), field.end(), '\n'));
+                if (!isCommand(fields)) continue;
+                bool ok = execute(fields);
+                cout << output;
+                output.clear();
+                if (!ok) cout << "line " << line << ": " << lastError << "\n";
+            }
+            return true;
+        }
+
+        // Results of the commands executed so far; the caller clears it.
+        string& getOutput() { return output; }
+        const string& getLastError() const { return lastError; }
+
+        size_t getApplied() const { return applied; }
+        size_t getFailed() const { return failed; }
+        // Successful commands that changed data.
+        size_t getMutations() const { return mutations; }
+};
+
+class CrmServer {
+    // Serves CommandProcessor commands to local clients over a Unix socket
+    // or a TCP port on 127.0.0.1. Each request is one CSV command record;
+    // its response is the command's result records followed by "OK" or
+    // "ERR <reason>" on a line of its own. Clients may pipeline.
+    // An epoll loop does the socket work and hands every complete request a
+    // connection has sent to a worker as one group, with at most one group
+    // per connection out at a time. Groups that only read go to a pool of
+    // reader threads, which run them on the published replica of a
+    // ConcurrentClientManager without waiting for writes. The rest go to a
+    // single writer thread, which applies all groups waiting for it as one
+    // version, commits once (e.g. one WAL sync) and only then answers them.
+    private:
+        static const size_t READ_CHUNK = 64 << 10;
+        // Stop reading from a client whose unsent responses exceed this.
+        static const size_t MAX_PENDING_OUTPUT = 4 << 20;
+
+        struct Connection {
+            string input;
+            string output;
+            size_t sent = 0;
+            bool reading = true;
+            // The client finished sending; close once its responses are out.
+            bool peerDone = false;
+            bool broken = false;
+            // A group of its requests is with a worker; it stays open until
+            // the group is back.
+            bool busy = false;
+            bool watched = true;
+        };
+
+        // Complete requests of one connection and, once run, their responses.
+        struct Group {
+            int fd;
+            string requests;
+            string output;
+        };
+
+        // A request of a group for the writer. Its first run answers it.
+        struct Write {
+            size_t group;
+            vector<string_view> fields;
+            string response;
+            bool answered = false;
+        };
+
+        ConcurrentClientManager& shared;
+        unsigned threads;
+        int listenFd = -1;
+        int epollFd = -1;
+        int wakeFd = -1;
+        string unixPath;
+        unordered_map<int, Connection> connections;
+
+        mutex queueLock;
+        condition_variable readWork;
+        condition_variable writeWork;
+        deque<unique_ptr<Group>> readQueue;
+        deque<unique_ptr<Group>> writeQueue;
+        bool stopping = false;
+        mutex finishedLock;
+        vector<unique_ptr<Group>> finished;
+
+        static volatile sig_atomic_t stopRequested;
+
+        static void onSignal(int) { stopRequested = 1; }
+
+        static bool setNonBlocking(int fd) {
+            int flags = ::fcntl(fd, F_GETFL, 0);
+            return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+        }
+
+        // A client that hung up while a group of it is out is taken out of
+        // epoll, which would report the hangup until the group is back.
+        void watch(int fd, Connection& connection) {
+            bool wanted = !(connection.busy && (connection.peerDone || connection.broken));
+            epoll_event event{};
+            event.events = (connection.reading ? EPOLLIN : 0u) | (connection.sent < connection.output.size() ? EPOLLOUT : 0u);
+            event.data.fd = fd;
+            if (wanted) ::epoll_ctl(epollFd, connection.watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+            else if (connection.watched) ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            connection.watched = wanted;
+        }
+
+        void acceptClients() {
+            while (true) {
+                int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) return;
+                int one = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.fd = fd;
+                if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                    ::close(fd);
+                    continue;
+                }
+                connections[fd];
+            }
+        }
+
+        // Reads what is available; returns the number of new bytes.
+        size_t receive(int fd, Connection& connection) {
+            size_t total = 0;
+            while (true) {
+                size_t old = connection.input.size();
+                connection.input.resize(old + READ_CHUNK);
+                ssize_t n = ::read(fd, &connection.input[old], READ_CHUNK);
+                connection.input.resize(old + (n > 0 ? static_cast<size_t>(n) : 0));
+                if (n > 0) {
+                    total += static_cast<size_t>(n);
+                    continue;
+                }
+                if (n == 0) connection.peerDone = true;
+                else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) connection.broken = true;
+                return total;
+            }
+        }
+
+        void send(int fd, Connection& connection) {
+            while (connection.sent < connection.output.size()) {
+                ssize_t n = ::send(fd, connection.output.data() + connection.sent,
+                                   connection.output.size() - connection.sent, MSG_NOSIGNAL);
+                if (n > 0) {
+                    connection.sent += static_cast<size_t>(n);
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+                connection.broken = true;
+                return;
+            }
+            if (connection.sent == connection.output.size()) {
+                connection.output.clear();
+                connection.sent = 0;
+            }
+        }
+
+        // Whether a request only reads, from its verb; blank records and
+        // comments do. Anything unclear goes to the writer.
+        static bool readsOnly(string_view record) {
+            while (!record.empty() && (record.back() == '\n' || record.back() == '\r')) record.remove_suffix(1);
+            if (record.empty() || record[0] == '#') return true;
+            return CommandProcessor::isReadOnly(record.substr(0, record.find(',')));
+        }
+
+        // Hands the connection's complete requests to a worker as one group,
+        // unless its previous group is still out.
+        void dispatch(int fd, Connection& connection) {
+            if (connection.busy || connection.broken) return;
+            size_t pos = 0;
+            size_t end = connection.input.size();
+            bool reads = true;
+            while (pos < end) {
+                size_t recordEnd = CsvReader::findRecordEnd(connection.input.data(), pos, end);
+                if (recordEnd == end) break;
+                reads = reads && readsOnly(string_view(connection.input.data() + pos, recordEnd - pos));
+                pos = recordEnd + 1;
+            }
+            if (pos == 0) return;
+
+            auto group = make_unique<Group>();
+            group->fd = fd;
+            group->requests.assign(connection.input, 0, pos);
+            connection.input.erase(0, pos);
+            connection.busy = true;
+            {
+                lock_guard<mutex> guard(queueLock);
+                (reads ? readQueue : writeQueue).push_back(move(group));
+            }
+            (reads ? readWork : writeWork).notify_one();
+        }
+
+        // Calls f() with fields set to each command in requests.
+        template <typename F>
+        static void forEachCommand(string& requests, vector<string_view>& fields, F&& f) {
+            size_t pos = 0;
+            while (pos < requests.size()) {
+                size_t recordEnd = CsvReader::findRecordEnd(requests.data(), pos, requests.size());
+                fields.clear();
+                CsvReader::splitRecord(&requests[pos], recordEnd - pos, fields);
+                pos = recordEnd + 1;
+                if (CommandProcessor::isCommand(fields)) f();
+            }
+        }
+
+        static void respond(CommandProcessor& processor, bool ok, string& out) {
+            string& results = processor.getOutput();
+            out.append(results);
+            results.clear();
+            if (ok) {
+                out.append("OK\n");
+            } else {
+                out.append("ERR ").append(processor.getLastError()).push_back('\n');
+            }
+        }
+
+        // Runs a write request on one replica: first to answer it, then on
+        // the other replica if it changed data. The replay leaves out the
+        // dedup report file, which the first run wrote.
+        bool perform(Write& write, ClientManager& data) {
+            CommandProcessor processor(data, threads);
+            if (write.answered) {
+                vector<string_view> fields = write.fields;
+                if (fields[0] == "dedup" && fields.size() == 3) fields.pop_back();
+                return processor.execute(fields);
+            }
+            write.answered = true;
+            bool ok = processor.execute(write.fields);
+            respond(processor, ok, write.response);
+            return processor.getMutations() > 0;
+        }
+
+        void applyWrites(vector<unique_ptr<Group>>& batch, const function<void()>& commit) {
+            // A deque, so the operations can hold on to their requests.
+            deque<Write> writes;
+            vector<ConcurrentClientManager::Operation> ops;
+            vector<string_view> fields;
+            for (size_t g = 0; g < batch.size(); g++) {
+                forEachCommand(batch[g]->requests, fields, [&] {
+                    writes.push_back(Write{g, fields, string(), false});
+                    Write& write = writes.back();
+                    ops.push_back([this, &write](ClientManager& data) { return perform(write, data); });
+                });
+            }
+            vector<bool> changed = shared.writeBatch(ops);
+            if (find(changed.begin(), changed.end(), true) != changed.end()) commit();
+            for (const Write& write : writes) batch[write.group]->output.append(write.response);
+        }
+
+        void readLoop() {
+            vector<string_view> fields;
+            while (true) {
+                unique_ptr<Group> group;
+                {
+                    unique_lock<mutex> guard(queueLock);
+                    readWork.wait(guard, [&] { return stopping || !readQueue.empty(); });
+                    if (readQueue.empty()) return;
+                    group = move(readQueue.front());
+                    readQueue.pop_front();
+                }
+                shared.read([&](const ClientManager& data) {
+                    CommandProcessor processor(data, threads);
+                    forEachCommand(group->requests, fields, [&] { respond(processor, processor.execute(fields), group->output); });
+                });
+                finish(move(group));
+            }
+        }
+
+        // Also runs idle after every batch and at least once a second.
+        void writeLoop(const function<void()>& commit, const function<void()>& idle) {
+            while (true) {
+                vector<unique_ptr<Group>> batch;
+                bool stop;
+                {
+                    unique_lock<mutex> guard(queueLock);
+                    writeWork.wait_for(guard, chrono::seconds(1), [&] { return stopping || !writeQueue.empty(); });
+                    stop = stopping;
+                    for (auto& group : writeQueue) batch.push_back(move(group));
+                    writeQueue.clear();
+                }
+                if (!batch.empty()) {
+                    applyWrites(batch, commit);
+                    for (auto& group : batch) finish(move(group));
+                }
+                idle();
+                if (stop && batch.empty()) return;
+            }
+        }
+
+        void finish(unique_ptr<Group> group) {
+            {
+                lock_guard<mutex> guard(finishedLock);
+                finished.push_back(move(group));
+            }
+            uint64_t one = 1;
+            ssize_t written = ::write(wakeFd, &one, sizeof(one));
+            (void)written;
+        }
+
+        // Queues the responses of finished groups and sends their
+        // connections' next requests off.
+        void collectFinished(vector<int>& ready) {
+            uint64_t count;
+            ssize_t got = ::read(wakeFd, &count, sizeof(count));
+            (void)got;
+            vector<unique_ptr<Group>> groups;
+            {
+                lock_guard<mutex> guard(finishedLock);
+                groups.swap(finished);
+            }
+            for (auto& group : groups) {
+                Connection& connection = connections[group->fd];
+                connection.output.append(group->output);
+                connection.busy = false;
+                dispatch(group->fd, connection);
+                ready.push_back(group->fd);
+            }
+        }
+
+    public:
+        CrmServer(ConcurrentClientManager& data, unsigned readers) : shared(data), threads(max(1u, readers)) {}
+        CrmServer(const CrmServer&) = delete;
+        CrmServer& operator=(const CrmServer&) = delete;
+
+        ~CrmServer() {
+            for (auto& entry : connections) ::close(entry.first);
+            if (listenFd >= 0) ::close(listenFd);
+            if (epollFd >= 0) ::close(epollFd);
+            if (wakeFd >= 0) ::close(wakeFd);
+            if (!unixPath.empty()) ::unlink(unixPath.c_str());
+        }
+
+        // Opens a connected socket to address, as accepted by listen().
+        static int connectTo(const string& address) {
+            int fd = -1;
+            if (address.rfind("unix:", 0) == 0) {
+                sockaddr_un where{};
+                where.sun_family = AF_UNIX;
+                string path = address.substr(5);
+                if (path.size() >= sizeof(where.sun_path)) return -1;
+                memcpy(where.sun_path, path.c_str(), path.size() + 1);
+                fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&where), sizeof(where)) != 0) {
+                    ::close(fd);
+                    fd = -1;
+                }
+            } else if (address.rfind("tcp:", 0) == 0) {
+                sockaddr_in where{};
+                where.sin_family = AF_INET;
+                where.sin_port = htons(static_cast<uint16_t>(atoi(address.c_str() + 4)));
+                where.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                int one = 1;
+                if (fd >= 0) ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&where), sizeof(where)) != 0) {
+                    ::close(fd);
+                    fd = -1;
+                }
+            }
+            return fd;
+        }
+
+        // address is "unix:<path>" or "tcp:<port>" (bound to 127.0.0.1 only).
+        bool listen(const string& address) {
+            if (address.rfind("unix:", 0) == 0) {
+                sockaddr_un where{};
+                where.sun_family = AF_UNIX;
+                string path = address.substr(5);
+                if (path.empty() || path.size() >= sizeof(where.sun_path)) {
+                    cout << "Error: invalid socket path " << path << ".\n";
+                    return false;
+                }
+                memcpy(where.sun_path, path.c_str(), path.size() + 1);
+                ::unlink(path.c_str());
+                listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&where), sizeof(where)) != 0) {
+                    cout << "Error: cannot bind " << path << ": " << strerror(errno) << "\n";
+                    return false;
+                }
+                unixPath = path;
+            } else if (address.rfind("tcp:", 0) == 0) {
+                sockaddr_in where{};
+                where.sin_family = AF_INET;
+                where.sin_port = htons(static_cast<uint16_t>(atoi(address.c_str() + 4)));
+                where.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                int one = 1;
+                if (listenFd >= 0) ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&where), sizeof(where)) != 0) {
+                    cout << "Error: cannot bind " << address << ": " << strerror(errno) << "\n";
                     return false;
+                }
+            } else {
+                cout << "Error: address must be unix:<path> or tcp:<port>.\n";
+                return false;
+            }
+
+            epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+            if (::listen(listenFd, SOMAXCONN) != 0 || !setNonBlocking(listenFd) || epollFd < 0) {
+                cout << "Error: cannot listen on " << address << ": " << strerror(errno) << "\n";
+                return false;
             }
-            cout << "Client updated successfully!\n";
-            return true;
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = listenFd;
+            return ::epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == 0;
         }
 
-        bool deleteClient(int index) {
-            if (index < 0 || index >= static_cast<int>(clients.size())) {
-                cout << "Invalid client index.\n";
-                return false;
+        // Serves until SIGINT or SIGTERM, with threads reader threads. commit
+        // runs after a batch of writes changed data and before they are
+        // answered; idle runs after every batch and at least once a second.
+        // Both run on the writer thread, which is the only one that may
+        // touch the wrapped ClientManager other than through reads.
+        void run(const function<void()>& commit, const function<void()>& idle) {
+            struct sigaction action{};
+            action.sa_handler = onSignal;
+            sigemptyset(&action.sa_mask);
+            ::sigaction(SIGINT, &action, nullptr);
+            ::sigaction(SIGTERM, &action, nullptr);
+            stopRequested = 0;
+
+            wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            epoll_event wake{};
+            wake.events = EPOLLIN;
+            wake.data.fd = wakeFd;
+            if (wakeFd < 0 || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wake) != 0) {
+                cout << "Error: cannot start the server: " << strerror(errno) << "\n";
+                return;
             }
+            stopping = false;
+            vector<thread> workers;
+            for (unsigned i = 0; i < threads; i++) workers.emplace_back([this] { readLoop(); });
+            workers.emplace_back([&] { writeLoop(commit, idle); });
 
-            string clientId = clients[index].getIdCard();
-            clients.erase(clients.begin() + index);
+            vector<epoll_event> events(256);
+            vector<int> ready;
+            while (!stopRequested) {
+                int count = ::epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 1000);
+                if (count < 0 && errno != EINTR) break;
 
-            auto it = clientInteractions.find(clientId);
-            if (it != clientInteractions.end()) {
-                for (auto* interaction : it->second) {
-                    delete interaction;
+                ready.clear();
+                for (int i = 0; i < count; i++) {
+                    int fd = events[i].data.fd;
+                    if (fd == listenFd) {
+                        acceptClients();
+                        continue;
+                    }
+                    if (fd == wakeFd) {
+                        collectFinished(ready);
+                        continue;
+                    }
+                    auto it = connections.find(fd);
+                    if (it == connections.end()) continue;
+                    Connection& connection = it->second;
+                    if (connection.reading && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) receive(fd, connection);
+                    else if (events[i].events & (EPOLLHUP | EPOLLERR)) connection.broken = true;
+                    // Also picks up requests left unread while output was backed up.
+                    dispatch(fd, connection);
+                    ready.push_back(fd);
+                }
+
+                for (int fd : ready) {
+                    auto it = connections.find(fd);
+                    if (it == connections.end()) continue;
+                    Connection& connection = it->second;
+                    if (!connection.broken) send(fd, connection);
+                    bool drained = connection.sent == connection.output.size();
+                    if (!connection.busy && (connection.broken || (connection.peerDone && drained))) {
+                        ::close(fd);
+                        connections.erase(it);
+                        continue;
+                    }
+                    connection.reading = !connection.peerDone && connection.output.size() - connection.sent < MAX_PENDING_OUTPUT;
+                    watch(fd, connection);
                 }
-                clientInteractions.erase(it);
             }
 
-            cout << "Client deleted successfully!\n";
-            return true;
+            {
+                lock_guard<mutex> guard(queueLock);
+                stopping = true;
+            }
+            readWork.notify_all();
+            writeWork.notify_all();
+            for (auto& worker : workers) worker.join();
         }
+};
 
-        vector<int> searchClients(const string& searchTerm) const {
-            vector<int> results;
-            string lowerSearchTerm = searchTerm;
-            transform(lowerSearchTerm.begin(), lowerSearchTerm.end(), lowerSearchTerm.begin(), ::tolower);
+volatile sig_atomic_t CrmServer::stopRequested = 0;
 
-            for (size_t i = 0; i < clients.size(); i++) {
-                string firstName = clients[i].getFirstName();
-                string lastName = clients[i].getLastName();
-                transform(firstName.begin(), firstName.end(), firstName.begin(), ::tolower);
-                transform(lastName.begin(), lastName.end(), lastName.begin(), ::tolower);
+class Autosaver {
+    // Writes saves on a thread of its own so that nobody waits for the disk.
+    // save() captures the manager on the calling thread, which must own it;
+    // that copy (see ClientManager::capture()) is the only pause. Requests
+    // that arrive while the worker is still busy are coalesced: the waiting
+    // image is brought up to date in place, so one write covers them all.
+    // due() tells the owner when the autosave interval has run out with
+    // changes unsaved; the owner checks it between commands.
+    public:
+        // Writes an image; runs on the worker. quiet is set when no request
+        // behind the image asked to be told about it.
+        using Writer = function<bool(ClientManager& image, bool quiet)>;
 
-                if (firstName.find(lowerSearchTerm) != string::npos ||
-                    lastName.find(lowerSearchTerm) != string::npos) {
-                    results.push_back(i);
-                }
+    private:
+        Writer writer;
+        chrono::seconds interval;
+        chrono::steady_clock::time_point lastCapture = chrono::steady_clock::now();
+        uint64_t capturedGeneration = 0;
+
+        mutex lock;
+        condition_variable wake;
+        condition_variable idle;
+        unique_ptr<ClientManager> pending;
+        bool pendingQuiet = true;
+        bool writing = false;
+        bool stopping = false;
+        bool lastSaved = true;
+        thread worker;
+
+        void loop() {
+            unique_lock<mutex> guard(lock);
+            while (true) {
+                wake.wait(guard, [this]() { return stopping || pending; });
+                if (!pending) break;
+                unique_ptr<ClientManager> image = move(pending);
+                bool quiet = pendingQuiet;
+                pendingQuiet = true;
+                writing = true;
+                guard.unlock();
+
+                bool saved = writer(*image, quiet);
+                image.reset();
+
+                guard.lock();
+                writing = false;
+                lastSaved = saved;
+                idle.notify_all();
             }
-            return results;
         }
 
-        void addInteraction(const string& clientId, Interaction* interaction) {
-            clientInteractions[clientId].push_back(interaction);
+    public:
+        // An interval of zero turns periodic saves off; save() still works.
+        Autosaver(Writer write, chrono::seconds every)
+            : writer(move(write)), interval(every), worker(&Autosaver::loop, this) {}
+
+        Autosaver(const Autosaver&) = delete;
+        Autosaver& operator=(const Autosaver&) = delete;
+
+        ~Autosaver() {
+            stop();
         }
 
-        void displayClientInteractions(const string& clientId) const {
-            auto it = clientInteractions.find(clientId);
-            if (it == clientInteractions.end() || it->second.empty()) {
-                cout << "No interactions found for this client.\n";
-                return;
-            }
+        bool due(const ClientManager& manager) const {
+            if (interval.count() == 0 || chrono::steady_clock::now() - lastCapture < interval) return false;
+            return !manager.getDirtySlots().empty() || manager.getGeneration() != capturedGeneration;
+        }
 
-            cout << "\n=== INTERACTIONS ===\n";
-            for (size_t i = 0; i < it->second.size(); i++) {
-                cout << "[" << i + 1 << "] " << it->second[i]->toString() << "\n";
-            }
+        void save(ClientManager& manager, bool quiet = false) {
+            lastCapture = chrono::steady_clock::now();
+            capturedGeneration = manager.getGeneration();
+            lock_guard<mutex> guard(lock);
+            if (!pending) pending = make_unique<ClientManager>();
+            manager.capture(*pending);
+            pendingQuiet = pendingQuiet && quiet;
+            wake.notify_one();
         }
 
-        const vector<Client>& getClients() const { return clients; }
-        void setClients(const vector<Client>& newClients) { clients = newClients; }
+        // Waits until every image handed over so far is written; false if
+        // the last write failed.
+        bool flush() {
+            unique_lock<mutex> guard(lock);
+            idle.wait(guard, [this]() { return !pending && !writing; });
+            return lastSaved;
+        }
 
-        const map<string, vector<Interaction*>>& getInteractions() const { return clientInteractions; }
+        // Writes what is still waiting, then ends the worker.
+        void stop() {
+            {
+                lock_guard<mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_one();
+            if (worker.joinable()) worker.join();
+        }
 };
 
-class FileManager {
-    public:
-        static bool saveToCSV(const string& filename, const ClientManager& manager) {
-            ofstream file(filename);
-            if (!file.is_open()) {
-                cout << "Error: Could not open file for writing.\n";
-                return false;
+class UserInterface {
+    private:
+        ClientManager& manager;
+        const string filename = "crm_data.csv";
+        const string snapshotFilename = "crm_data.snap";
+        const string packedFilename = "crm_data.crz";
+        unsigned workerThreads;
+        // Saves go to packedFilename, rewritten whole but compressed, instead
+        // of the segment store.
+        bool packedStorage;
+        WriteAheadLog wal{"crm_data.wal"};
+        SegmentStore segments{"crm_data.segments"};
+        bool logging = false;
+        // Set after a load rejected the CSV: saving what is left would
+        // supersede the file, so nothing is saved until a load succeeds.
+        bool loadRejected = false;
+        ClientOrder listOrder = ClientOrder::Slot;
+        // Last member, so its worker is joined before the stores it writes
+        // to go away.
+        Autosaver autosaver;
+
+        static constexpr size_t PAGE_SIZE = 20;
+
+        // Saved data is used unless the CSV was modified after it was written,
+        // so dropping in a new CSV still imports it.
+        bool newerThanCsv(const struct stat& saved) const {
+            struct stat csv;
+            if (stat(filename.c_str(), &csv) != 0) return true;
+            if (saved.st_mtim.tv_sec != csv.st_mtim.tv_sec) return saved.st_mtim.tv_sec > csv.st_mtim.tv_sec;
+            return saved.st_mtim.tv_nsec >= csv.st_mtim.tv_nsec;
+        }
+
+        bool snapshotIsCurrent() const {
+            struct stat snap;
+            return stat(snapshotFilename.c_str(), &snap) == 0 && newerThanCsv(snap);
+        }
+
+        // The log holds every change made after the snapshot, so whichever of
+        // the snapshot and the segments has the higher sequence is complete
+        // once the log is replayed on top of it.
+        bool loadSaved(bool& fromSnapshot) {
+            struct stat info;
+            uint64_t savedSequence = 0, snapshotSequence = 0;
+            bool found = packedStorage
+                ? FileManager::packedSequence(packedFilename, savedSequence) && stat(packedFilename.c_str(), &info) == 0
+                : segments.savedSequence(savedSequence) && segments.savedTime(info);
+            if (!found || !newerThanCsv(info)) return false;
+            if (FileManager::snapshotSequence(snapshotFilename, snapshotSequence) &&
+                snapshotSequence >= savedSequence && FileManager::loadSnapshot(snapshotFilename, manager)) {
+                fromSnapshot = true;
+                if (!packedStorage) segments.adopt(manager);
+                return true;
             }
+            if (packedStorage) return FileManager::loadPacked(packedFilename, manager, workerThreads);
+            return segments.load(manager, workerThreads);
+        }
 
-            file << "ID_Card,First_Name,Last_Name,Email,Policy_Number,Company_Name,Interaction_Type,Description,Sales_Person,Date,Hour,Value,Status\n";
+        // Loads the base, replays the write-ahead log on top of it and then
+        // folds everything into a fresh snapshot, so the snapshot is always
+        // the base the live log applies to. False if the CSV was rejected;
+        // then nothing may be saved, as that would supersede the CSV.
+        bool loadData() {
+            autosaver.flush();
+            wal.close();
+            manager.setChangeLog(nullptr);
+            logging = false;
 
-            const auto& clients = manager.getClients();
-            const auto& interactions = manager.getInteractions();
-
-            for (const auto& client : clients) {
-                string clientId = client.getIdCard();
-                auto it = interactions.find(clientId);
-                if (it != interactions.end() && !it->second.empty()) {
-                    for (const auto* interaction : it->second) {
-                        file << client.getIdCard() << ","
-                             << client.getFirstName() << ","
-                             << client.getLastName() << ","
-                             << client.getEmail() << ","
-                             << client.getPolicyNumber() << ","
-                             << client.getCompany().getName() << ","
-                             << interaction->getType() << ","
-                             << interaction->getDescription();
-
-                        if (interaction->getType() == "Appointment") {
-                            const Appointment* apt = dynamic_cast<const Appointment*>(interaction);
-                            file << "," << apt->getSalesPerson() << "," << apt->getDate() << "," << apt->getHour() << ",,";
-                        } else if (interaction->getType() == "Contract") {
-                            const Contract* contract = dynamic_cast<const Contract*>(interaction);
-                            stringstream ss;
-                            ss << fixed << setprecision(2) << contract->getValue();
-                            file << ",,," << ss.str() << "," << contract->getStatus();
-                        }
-                        file << "\n";
-                    }
+            bool fromSnapshot = false;
+            loadRejected = false;
+            if (!loadSaved(fromSnapshot)) {
+                fromSnapshot = snapshotIsCurrent() && FileManager::loadSnapshot(snapshotFilename, manager);
+                if (!fromSnapshot) FileManager::loadFromCSV(filename, manager, workerThreads, &loadRejected);
+                if (loadRejected) return false;
+            }
+
+            size_t fromSealed = 0, fromActive = 0;
+            WriteAheadLog::replay(wal.sealedPath(), manager, fromSealed);
+            size_t validBytes = WriteAheadLog::replay(wal.getPath(), manager, fromActive);
+            if (fromSealed + fromActive > 0) {
+                cout << "Recovered " << fromSealed + fromActive << " logged changes from " << wal.getPath() << "\n";
+            }
+
+            // Unless the snapshot is already the base, it has to be rewritten
+            // to become one; if that fails, the log stays on top of data the
+            // snapshot lacks and must not be compacted into it.
+            struct stat info;
+            bool sealedExists = stat(wal.sealedPath().c_str(), &info) == 0;
+            uint64_t base = manager.getLogSequence();
+            if (!fromSnapshot || fromSealed + fromActive > 0 || sealedExists) {
+                if (FileManager::saveSnapshot(snapshotFilename, manager)) {
+                    ::unlink(wal.sealedPath().c_str());
+                    validBytes = 0;
                 } else {
-                    file << client.getIdCard() << ","
-                         << client.getFirstName() << ","
-                         << client.getLastName() << ","
-                         << client.getEmail() << ","
-                         << client.getPolicyNumber() << ","
-                         << client.getCompany().getName() << ","
-                         << ",,,,,,\n";
+                    base = WriteAheadLog::NO_BASE;
                 }
             }
 
-            file.close();
-            cout << "Data saved to " << filename << " successfully!\n";
+            if (!wal.open(validBytes, manager.getLogSequence(), base)) {
+                cout << "Warning: could not open " << wal.getPath() << "; changes are only kept until the next save.\n";
+                return true;
+            }
+            manager.setChangeLog(&wal);
+            logging = true;
             return true;
         }
 
+        // Runs on the autosave thread. Only the segments holding changes are
+        // rewritten; packed storage rewrites its one file. The log is kept, as
+        // it still applies to the snapshot; unlogged changes have to go into
+        // the snapshot as well, or it would look as current as the saved data
+        // while missing them. logging only changes while the saver is idle.
+        bool writeImage(ClientManager& image, bool quiet) {
+            bool saved = packedStorage ? FileManager::savePacked(packedFilename, image, workerThreads, quiet)
+                                       : segments.save(image, quiet);
+            if (!saved || logging) return saved;
+            wal.waitForCompaction();
+            if (FileManager::saveSnapshot(snapshotFilename, image, quiet)) wal.reset();
+            return true;
+        }
 
-        static bool loadFromCSV(const string& filename, ClientManager& manager) {
-            ifstream file(filename);
-            if (!file.is_open()) {
-                cout << "Warning: Could not open file " << filename << ". Starting with empty database.\n";
+        // Returns once the data is captured; the autosave thread writes it.
+        // False if nothing may be saved after a rejected load.
+        bool saveData(bool quiet = false) {
+            if (loadRejected) {
+                if (!quiet) cout << "Error: Not saved, as the last load was rejected; load the data again first.\n";
                 return false;
             }
-
-            string line;
-            getline(file, line);
-
-            vector<Client> clients;
-            map<string, bool> clientExists;
-
-            while (getline(file, line)) {
-                if (line.empty()) continue;
-
-                stringstream ss(line);
-                string idCard, firstName, lastName, email, policyStr, companyName;
-                string interactionType, description, salesPerson, date, hour, valueStr, status;
-
-                getline(ss, idCard, ',');
-                getline(ss, firstName, ',');
-                getline(ss, lastName, ',');
-                getline(ss, email, ',');
-                getline(ss, policyStr, ',');
-                getline(ss, companyName, ',');
-                getline(ss, interactionType, ',');
-                getline(ss, description, ',');
-                getline(ss, salesPerson, ',');
-                getline(ss, date, ',');
-                getline(ss, hour, ',');
-                getline(ss, valueStr, ',');
-                getline(ss, status, ',');
-
-                try {
-                    if (clientExists.find(idCard) == clientExists.end()) {
-                        int policyNumber = stoi(policyStr);
-
-                        Client client;
-                        client.setIdCard(idCard);
-                        client.setFirstName(firstName);
-                        client.setLastName(lastName);
-                        client.setEmail(email);
-                        client.setPolicyNumber(policyNumber);
-
-                        Company company;
-                        company.setName(companyName);
-                        client.setCompany(company);
-
-                        clients.push_back(client);
-                        clientExists[idCard] = true;
-                    }
-
-                    if (!interactionType.empty()) {
-                        if (interactionType == "Appointment") {
-                            manager.addInteraction(idCard, new Appointment(description, salesPerson, date, hour));
-                        } else if (interactionType == "Contract") {
-                            double value = 0.0;
-                            if (!valueStr.empty()) {
-                                try {
-                                    value = stod(valueStr);
-                                } catch (const exception& e) {
-                                    cout << "Warning: Invalid contract value '" << valueStr << "', using 0.0\n";
-                                }
-                            }
-                            manager.addInteraction(idCard, new Contract(description, value, status));
-                        }
-                    }
-                } catch (const exception& e) {
-                    cout << "Error loading data: " << e.what() << endl;
-                }
-            }
-
-            manager.setClients(clients);
-            file.close();
-            cout << "Data loaded from " << filename << " successfully! (" << clients.size() << " clients)\n";
+            autosaver.save(manager, quiet);
             return true;
         }
 
-};
+        void autosaveIfDue() {
+            if (autosaver.due(manager)) saveData(true);
+        }
 
-class UserInterface {
-    private:
-        ClientManager& manager;
-        const string filename = "crm_data.csv";
+        // Saves and waits for the write to finish, so nothing is still in
+        // flight when the program exits. False if it failed.
+        bool saveAndWait() {
+            if (!saveData()) return false;
+            if (autosaver.flush()) return true;
+            cout << "Error: The data could not be saved.\n";
+            return false;
+        }
 
     public:
-        UserInterface(ClientManager& mgr) : manager(mgr) {}
+        UserInterface(ClientManager& mgr, unsigned threads = 1, bool packed = false,
+                      chrono::seconds autosaveInterval = chrono::seconds(0))
+            : manager(mgr), workerThreads(threads), packedStorage(packed),
+              autosaver([this](ClientManager& image, bool quiet) { return writeImage(image, quiet); }, autosaveInterval) {}
+
+        // Applies the commands in commandFile to the loaded data and saves
+        // once at the end instead of logging each change. Nothing is saved
+        // if the batch is interrupted. Returns false if any command failed.
+        bool runBatch(const string& commandFile) {
+            if (!loadData()) return false;
+            manager.setChangeLog(nullptr);
+            logging = false;
+
+            auto startTime = chrono::steady_clock::now();
+            CommandProcessor processor(manager, workerThreads);
+            bool readable = processor.run(commandFile);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+            stringstream stats;
+            stats << fixed << setprecision(2) << "Batch: " << processor.getApplied() << " command(s) applied, "
+                  << processor.getFailed() << " failed in " << seconds << " s\n";
+            cout << stats.str();
+
+            bool saved = processor.getMutations() == 0 || saveAndWait();
+            autosaver.flush();
+            wal.close();
+            return saved && readable && processor.getFailed() == 0;
+        }
+
+        // Owns the data for other processes until SIGINT/SIGTERM, answering
+        // reads on workerThreads threads while changes are applied. Changes
+        // are logged as usual and each batch of them is made durable before
+        // it is answered; the data is saved on shutdown.
+        bool runServer(const string& address) {
+            manager.setEagerIndexes(true);
+            if (!loadData()) return false;
+            // Readers get a replica of their own; changes go to both and are
+            // logged once, and manager stays the one that is saved.
+            manager.setChangeLog(nullptr);
+            ConcurrentClientManager shared(manager);
+            shared.setChangeLog(logging ? &wal : nullptr);
+            CrmServer server(shared, workerThreads);
+            if (!server.listen(address)) {
+                wal.close();
+                return false;
+            }
+            cout << "Serving on " << address << " (Ctrl+C to stop)" << endl;
+            server.run([&] { wal.sync(); }, [&] {
+                autosaveIfDue();
+                if (wal.needsCompaction()) wal.startCompaction(snapshotFilename);
+            });
+            cout << "Shutting down server.\n";
+            // Nobody is left to ask, so retry a few times before giving up.
+            bool saved = saveAndWait();
+            for (int attempt = 1; !saved && attempt < 3; ++attempt) {
+                this_thread::sleep_for(chrono::seconds(1));
+                saved = saveAndWait();
+            }
+            wal.close();
+            manager.setChangeLog(nullptr);
+            return saved;
+        }
 
         void displayMainMenu() {
             cout << "\n=== CRM SYSTEM ===\n";
@@ -433,7 +7543,10 @@ class UserInterface {
             cout << "6. Manage Interactions\n";
             cout << "7. Save Data\n";
             cout << "8. Load Data\n";
-            cout << "9. Exit\n";
+            cout << "9. Reports\n";
+            cout << "10. Calendar\n";
+            cout << "11. Stats\n";
+            cout << "12. Exit\n";
             cout << "Choose option: ";
         }
 
@@ -462,23 +7575,15 @@ class UserInterface {
             cin.ignore();
             getline(cin, companyName);
 
-            Client client;
-            client.setIdCard(idCard);
-            client.setFirstName(firstName);
-            client.setLastName(lastName);
-            client.setEmail(email);
-            client.setPolicyNumber(policyNumber);
-
-            Company company;
-            company.setName(companyName);
-            client.setCompany(company);
+            Client client(move(idCard), move(firstName), move(lastName), move(email), policyNumber, Company(companyName));
 
-            manager.addClient(client);
-            cout << "Client added successfully!\n";
+            if (manager.addClient(client)) {
+                cout << "Client added successfully!\n";
+            }
         }
 
         void editClientFlow() {
-            if (manager.getClients().empty()) {
+            if (manager.clientCount() == 0) {
                 cout << "No clients found.\n";
                 return;
             }
@@ -518,13 +7623,53 @@ class UserInterface {
             }
         }
 
-        void deleteClientFlow() {
-            manager.displayAllClients();
-            if (manager.getClients().empty()) return;
+        // Calls show(offset) for a page of count rows at a time and handles
+        // n/p (and s, cycling listOrder, if sortable) itself; returns whatever
+        // else the operator enters. A list that fits on one page only asks
+        // for input if there is a prompt, otherwise "" comes back at once.
+        string pageThrough(size_t count, const string& prompt, bool sortable, const function<void(size_t)>& show) {
+            size_t offset = 0;
+            while (true) {
+                show(offset);
+                bool paged = count > PAGE_SIZE;
+                if (!paged && prompt.empty()) return "";
+                cout << "\n" << prompt;
+                if (paged) {
+                    cout << (prompt.empty() ? "[" : " [") << "n: next page, p: previous page"
+                         << (sortable ? ", s: sort" : "") << (prompt.empty() ? ", q: done]" : "]");
+                }
+                cout << ": ";
+                string input;
+                if (!(cin >> input)) return "";
+                if (paged && input == "n") {
+                    if (offset + PAGE_SIZE < count) offset += PAGE_SIZE;
+                } else if (paged && input == "p") {
+                    offset -= min(offset, PAGE_SIZE);
+                } else if (paged && sortable && input == "s") {
+                    listOrder = static_cast<ClientOrder>((static_cast<int>(listOrder) + 1) % 4);
+                    offset = 0;
+                } else {
+                    return input;
+                }
+            }
+        }
+
+        // All clients, a page at a time; returns what pageThrough() does.
+        string browseClients(const string& prompt) {
+            if (manager.clientCount() == 0) {
+                cout << "No clients found.\n";
+                return "";
+            }
+            return pageThrough(manager.clientCount(), prompt, true,
+                               [&](size_t offset) { manager.displayAllClients(listOrder, offset, PAGE_SIZE); });
+        }
 
-            cout << "\nEnter client number to delete: ";
-            int index;
-            cin >> index;
+        void deleteClientFlow() {
+            if (manager.clientCount() == 0) {
+                cout << "No clients found.\n";
+                return;
+            }
+            int index = atoi(browseClients("Enter client number to delete").c_str());
 
             cout << "Are you sure? (y/n): ";
             char confirm;
@@ -541,35 +7686,47 @@ class UserInterface {
             getline(cin, searchTerm);
 
             vector<int> results = manager.searchClients(searchTerm);
+            const auto& clients = manager.getClients();
             if (results.empty()) {
-                cout << "No clients found.\n";
+                // Most misses are typos, so offer the closest spellings.
+                vector<FuzzyIndex::Match> closest = manager.fuzzySearch(searchTerm, PAGE_SIZE);
+                if (closest.empty()) {
+                    cout << "No clients found.\n";
+                    return;
+                }
+                ClientTable table;
+                table.line("\nNo exact match. Closest clients:");
+                for (const auto& match : closest) {
+                    table.brief(match.slot, clients[match.slot], " | Match: " + to_string(lround(match.score * 100)) + "%");
+                }
+                table.flush();
                 return;
             }
 
-            cout << "\n=== SEARCH RESULTS ===\n";
-            const auto& clients = manager.getClients();
-            for (int index : results) {
-                cout << "[" << index + 1 << "] ";
-                cout << "Name: " << clients[index].getFirstName() << " " << clients[index].getLastName();
-                cout << " | Email: " << clients[index].getEmail() << "\n";
-            }
+            pageThrough(results.size(), "", false, [&](size_t offset) {
+                ClientTable table;
+                size_t end = min(results.size(), offset + PAGE_SIZE);
+                if (results.size() <= PAGE_SIZE) table.line("\n=== SEARCH RESULTS ===");
+                else table.line("\n=== SEARCH RESULTS (" + to_string(offset + 1) + "-" + to_string(end) + " of " + to_string(results.size()) + ") ===");
+                for (size_t i = offset; i < end; i++) table.brief(results[i], clients[results[i]]);
+                table.flush();
+            });
         }
 
         void manageInteractionsFlow() {
-            manager.displayAllClients();
-            if (manager.getClients().empty()) return;
-
-            cout << "\nEnter client number: ";
-            int index;
-            cin >> index;
+            if (manager.clientCount() == 0) {
+                cout << "No clients found.\n";
+                return;
+            }
+            int index = atoi(browseClients("Enter client number").c_str());
 
-            if (index < 1 || index > static_cast<int>(manager.getClients().size())) {
+            if (!manager.isLive(index - 1)) {
                 cout << "Invalid client number.\n";
                 return;
             }
 
-            const Client& client = manager.getClients()[index - 1];
-            string clientId = client.getIdCard();
+            const ClientRecord& client = manager.getClients()[index - 1];
+            string clientId(client.getIdCard());
 
             cout << "\n1. Add Appointment\n2. Add Contract\n3. View Interactions\nChoose: ";
             int choice;
@@ -587,8 +7744,16 @@ class UserInterface {
                     getline(cin, date);
                     cout << "Enter appointment hour (HH:MM): ";
                     getline(cin, hour);
-                    manager.addInteraction(clientId, new Appointment(desc, salesperson, date, hour));
-                    cout << "Appointment added!\n";
+                    AppointmentTime when;
+                    if (!AppointmentTime::parse(date, hour, when)) {
+                        cout << "Invalid date or hour.\n";
+                        break;
+                    }
+                    if (manager.addInteraction(clientId, Appointment(desc, salesperson, when))) {
+                        cout << "Appointment added!\n";
+                        break;
+                    }
+                    for (const auto& ref : manager.getInteractionStore().conflicts(salesperson, when)) printAppointment(ref);
                     break;
                 }
                 case 2: {
@@ -602,8 +7767,9 @@ class UserInterface {
                     cout << "Enter contract status: ";
                     cin.ignore();
                     getline(cin, status);
-                    manager.addInteraction(clientId, new Contract(desc, value, status));
-                    cout << "Contract added!\n";
+                    if (manager.addInteraction(clientId, Contract(desc, value, status))) {
+                        cout << "Contract added!\n";
+                    }
                     break;
                 }
                 case 3:
@@ -614,41 +7780,837 @@ class UserInterface {
             }
         }
 
-        void run() {
-            FileManager::loadFromCSV(filename, manager);
+        void printAppointment(const InteractionRef& ref) const {
+            const InteractionStore& store = manager.getInteractionStore();
+            const Appointment& apt = store.appointment(ref);
+            const ClientRecord& client = manager.getClients()[store.ownerSlot(ref)];
+            cout << "  " << apt.getDate() << " " << apt.getHour() << " | " << apt.getSalesPerson() << " | "
+                 << client.getFirstName() << " " << client.getLastName() << " (" << client.getIdCard() << ") | "
+                 << apt.getDescription() << "\n";
+        }
+
+        // Reads a YYYY-MM-DD date as a day number; prints an error if invalid.
+        bool readDay(const string& prompt, int64_t& day) {
+            string input;
+            cout << prompt;
+            getline(cin, input);
+            if (AppointmentTime::parseDate(input, day)) return true;
+            cout << "Invalid date.\n";
+            return false;
+        }
+
+        void calendarFlow() {
+            cout << "\n1. Appointments in a date range\n2. Salesperson schedule\nChoose: ";
+            int choice;
+            cin >> choice;
+            cin.ignore();
+
+            const InteractionStore& store = manager.getInteractionStore();
+            string salesPerson;
+            if (choice == 2) {
+                cout << "Enter salesperson name: ";
+                getline(cin, salesPerson);
+            } else if (choice != 1) {
+                cout << "Invalid choice.\n";
+                return;
+            }
+            int64_t first, last;
+            if (!readDay("From date (YYYY-MM-DD): ", first) || !readDay("To date (YYYY-MM-DD): ", last)) return;
+
+            AppointmentTime from = AppointmentTime::startOfDay(first);
+            AppointmentTime to = AppointmentTime::startOfDay(last + 1);
+            vector<InteractionRef> found = choice == 1 ? store.appointmentsBetween(from, to)
+                                                       : store.appointmentsBetween(salesPerson, from, to);
+            if (found.empty()) {
+                cout << "No appointments found.\n";
+                return;
+            }
+            cout << "\n=== APPOINTMENTS ===\n";
+            int64_t previousStart = 0;
+            for (size_t i = 0; i < found.size(); i++) {
+                printAppointment(found[i]);
+                int64_t start = store.appointment(found[i]).getTime().getMinutes();
+                if (choice == 2 && i > 0 && start - previousStart < Appointment::SLOT_MINUTES) {
+                    cout << "    ^ double-booked with the appointment above\n";
+                }
+                previousStart = start;
+            }
+            cout << found.size() << " appointment(s).\n";
+        }
+
+        void reportsFlow() {
+            const InteractionStore& store = manager.getInteractionStore();
+            auto startTime = chrono::steady_clock::now();
+            Reports::Totals totals = Reports::contractTotals(store, workerThreads);
+            vector<Reports::Group> byStatus = Reports::contractsByStatus(store, workerThreads);
+            vector<Reports::MonthlyCount> bySalesPerson = Reports::appointmentsBySalesPersonMonth(store, workerThreads);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+            stringstream out;
+            out << fixed << setprecision(2);
+            out << "\n=== CONTRACT PIPELINE ===\n";
+            out << "Contracts: " << totals.count << " | Total: $" << totals.sum << " | Average: $" << totals.average();
+            if (totals.count > 0) out << " | Min: $" << totals.min << " | Max: $" << totals.max;
+            out << "\n";
+            for (const auto& group : byStatus) {
+                out << "  " << left << setw(16) << group.key << right << setw(10) << group.count
+                    << "  Total: $" << group.sum << "  Average: $" << group.average() << "\n";
+            }
+
+            out << "\n=== APPOINTMENTS PER SALESPERSON PER MONTH ===\n";
+            if (bySalesPerson.empty()) out << "No appointments.\n";
+            for (const auto& row : bySalesPerson) {
+                out << "  " << left << setw(16) << row.salesPerson << right << setw(4) << row.year << "-"
+                    << setfill('0') << setw(2) << row.month << setfill(' ') << setw(10) << row.count << "\n";
+            }
+            out << "\nComputed over " << store.getContracts().size() << " contracts and "
+                << store.getAppointments().size() << " appointments in " << seconds * 1000 << " ms\n";
+            cout << out.str();
+        }
+
+        void statsFlow() {
+            Metrics::Totals totals = Metrics::snapshot();
+            cout << "\n=== STATS ===\n" << Metrics::toTable(totals);
+
+            cout << "Write JSON to file (empty to skip): ";
+            cin.ignore();
+            string filename;
+            getline(cin, filename);
+            if (filename.empty()) return;
+            ofstream file(filename);
+            file << Metrics::toJson(totals) << "\n";
+            file.close();
+            if (!file) {
+                cout << "Error: Could not write " << filename << ".\n";
+                return;
+            }
+            cout << "Stats written to " << filename << "\n";
+        }
+
+        // False if the session ends after a load rejected the CSV; the data
+        // is then not saved on exit.
+        bool run() {
+            manager.setEagerIndexes(true);
+            if (!loadData()) return false;
 
             int choice;
             do {
                 displayMainMenu();
                 cin >> choice;
+                // End of input exits as 12 does; nobody is left to retry.
+                if (cin.eof()) choice = 12;
 
                 switch (choice) {
                     case 1: addClientFlow(); break;
-                    case 2: manager.displayAllClients(); break;
+                    case 2: browseClients(""); break;
                     case 3: editClientFlow(); break;
                     case 4: deleteClientFlow(); break;
                     case 5: searchClientFlow(); break;
                     case 6: manageInteractionsFlow(); break;
-                    case 7: FileManager::saveToCSV(filename, manager); break;
-                    case 8: FileManager::loadFromCSV(filename, manager); break;
-                    case 9:
-                        FileManager::saveToCSV(filename, manager);
+                    case 7:
+                        if (saveData()) cout << "Saving in the background.\n";
+                        break;
+                    case 8:
+                        if (!loadData()) cout << "Changes are not saved until a load succeeds.\n";
+                        break;
+                    case 9: reportsFlow(); break;
+                    case 10: calendarFlow(); break;
+                    case 11: statsFlow(); break;
+                    case 12:
+                        if (!loadRejected && !saveAndWait() && !cin.eof()) {
+                            cout << "Not shutting down; fix the problem and try again.\n";
+                            choice = 0;
+                            break;
+                        }
                         cout << "Shutting down!\n";
                         break;
                     default: cout << "Invalid choice.\n";
                 }
-            } while (choice != 9);
+                autosaveIfDue();
+                if (wal.needsCompaction()) wal.startCompaction(snapshotFilename);
+            } while (choice != 12);
+
+            wal.close();
+            manager.setChangeLog(nullptr);
+            return !loadRejected;
         }
 };
 
-int main() {
-    cout << "InsuraPro CRM\n";
-    cout << "=============\n";
+// Self-check for ConcurrentClientManager, also meant to be run in a
+// -fsanitize=thread build. One writer publishes client pairs (each with a
+// contract on the first client) and retires old pairs, one version per
+// change, while readers check that every version they see holds whole
+// pairs only. Runs with 1, 2, 4... up to maxReaders reader threads and
+// prints read throughput for each.
+int runStressTest(unsigned maxReaders, double secondsPerRound) {
+    const int LIVE_PAIRS = 5000;
+    auto pairOps = [](int k, vector<ConcurrentClientManager::Operation>& ops) {
+        for (const char* side : {"a", "b"}) {
+            Client client;
+            client.setIdCard("P" + to_string(k) + side);
+            client.setFirstName(string("Stress") + side);
+            client.setLastName("Pair" + to_string(k % 100));
+            client.setEmail("p" + to_string(k) + side + "@stress.test");
+            client.setPolicyNumber(k * 2 + (side[0] == 'b'));
+            ops.push_back([client](ClientManager& m) { return m.addClient(client); });
+        }
+        string owner = "P" + to_string(k) + "a";
+        ops.push_back([owner](ClientManager& m) { return m.addInteraction(owner, Contract("Stress", 1.0, "Signed")); });
+    };
+    auto retireOp = [](int k) -> ConcurrentClientManager::Operation {
+        return [k](ClientManager& m) {
+            bool ok = true;
+            for (const char* side : {"a", "b"}) {
+                int slot = m.findById("P" + to_string(k) + side);
+                ok = slot >= 0 && m.removeClient(slot) && ok;
+            }
+            return ok;
+        };
+    };
 
-    ClientManager manager;
-    UserInterface ui(manager);
+    ConcurrentClientManager manager;
+    vector<ConcurrentClientManager::Operation> ops;
+    for (int k = 0; k < LIVE_PAIRS; k++) pairOps(k, ops);
+    manager.writeBatch(ops);
+    atomic<int> nextPair(LIVE_PAIRS);
+    atomic<size_t> violations(0);
+
+    vector<unsigned> rounds;
+    for (unsigned count = 1; count < maxReaders; count *= 2) rounds.push_back(count);
+    rounds.push_back(maxReaders);
+
+    cout << "readers    reads/s   versions/s\n";
+    for (unsigned readerCount : rounds) {
+        atomic<bool> stop(false);
+        atomic<size_t> reads(0);
+        uint64_t firstVersion = manager.getVersion();
+
+        vector<thread> threads;
+        for (unsigned r = 0; r < readerCount; r++) {
+            threads.emplace_back([&, r] {
+                uint64_t state = 0x9E3779B97F4A7C15ULL * (r + 1);
+                size_t done = 0;
+                while (!stop.load(memory_order_relaxed)) {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    int k = static_cast<int>(state % static_cast<uint64_t>(nextPair.load()));
+                    bool checkTotals = done % 256 == 0;
+                    bool consistent = manager.read([&](const ClientManager& m) {
+                        bool first = m.findById("P" + to_string(k) + "a") >= 0;
+                        bool second = m.findById("P" + to_string(k) + "b") >= 0;
+                        if (first != second || m.clientCount() % 2 != 0) return false;
+                        if (checkTotals) {
+                            Reports::Totals totals = Reports::contractTotals(m.getInteractionStore());
+                            if (totals.count * 2 != m.clientCount()) return false;
+                            if (m.searchClientsByPrefix("Pair" + to_string(k % 100)).size() % 2 != 0) return false;
+                        }
+                        return true;
+                    });
+                    if (!consistent) violations++;
+                    done++;
+                }
+                reads += done;
+            });
+        }
+
+        auto startTime = chrono::steady_clock::now();
+        while (chrono::duration<double>(chrono::steady_clock::now() - startTime).count() < secondsPerRound) {
+            int k = nextPair.load();
+            ops.clear();
+            pairOps(k, ops);
+            ops.push_back(retireOp(k - LIVE_PAIRS));
+            manager.writeBatch(ops);
+            nextPair.store(k + 1);
+        }
+        stop = true;
+        for (auto& t : threads) t.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
 
-    ui.run();
+        stringstream line;
+        line << fixed << setprecision(0) << setw(7) << readerCount << setw(11) << reads.load() / seconds
+             << setw(13) << (manager.getVersion() - firstVersion) / seconds << "\n";
+        cout << line.str();
+    }
 
+    if (violations > 0) {
+        cout << "FAILED: " << violations << " inconsistent reads\n";
+        return 1;
+    }
+    cout << "OK: every read saw a consistent version\n";
     return 0;
 }
+
+// Load generator for a running server (--serve). Each connection runs on
+// its own thread: it first adds its own clients, then sends a read-mostly
+// mix (80% get by ID, 10% name search, 10% new contract) keeping up to
+// pipeline requests in flight. Prints throughput and latency percentiles.
+int runLoadTest(const string& address, unsigned connectionCount, size_t requestsPerConnection, unsigned pipeline) {
+    const int CLIENTS_PER_CONNECTION = 1000;
+    // Run-specific IDs and (negative) policy numbers, so repeated runs and
+    // real data do not collide.
+    int run = getpid() % 10000;
+    string tag = to_string(run);
+    connectionCount = min(connectionCount, 100u);
+
+    struct Result {
+        vector<double> latencies;
+        size_t errors = 0;
+        bool failed = false;
+    };
+
+    // Sends requests produced by next(i) for i in [0, count) with up to
+    // pipeline in flight, timing each one until its OK/ERR line arrives.
+    auto drive = [&](int fd, size_t count, const function<string(size_t)>& next, Result& result) {
+        vector<chrono::steady_clock::time_point> sentAt(count);
+        string out, in;
+        size_t sent = 0, done = 0, lineStart = 0;
+        char buffer[64 << 10];
+        while (done < count) {
+            out.clear();
+            while (sent < count && sent - done < pipeline) {
+                out += next(sent);
+                sentAt[sent++] = chrono::steady_clock::now();
+            }
+            for (size_t off = 0; off < out.size();) {
+                ssize_t n = ::send(fd, out.data() + off, out.size() - off, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    result.failed = true;
+                    return;
+                }
+                off += static_cast<size_t>(n);
+            }
+            ssize_t n = ::read(fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                result.failed = true;
+                return;
+            }
+            in.append(buffer, static_cast<size_t>(n));
+            auto now = chrono::steady_clock::now();
+            for (size_t nl = in.find('\n', lineStart); nl != string::npos; nl = in.find('\n', lineStart)) {
+                string_view line(in.data() + lineStart, nl - lineStart);
+                lineStart = nl + 1;
+                bool ok = line == "OK";
+                if (!ok && line.rfind("ERR", 0) != 0) continue;
+                if (!ok) result.errors++;
+                result.latencies.push_back(chrono::duration<double, micro>(now - sentAt[done++]).count());
+            }
+            in.erase(0, lineStart);
+            lineStart = 0;
+        }
+    };
+
+    auto runPhase = [&](const string& name, size_t count, const function<string(unsigned, size_t)>& request) {
+        vector<Result> results(connectionCount);
+        vector<thread> workers;
+        auto startTime = chrono::steady_clock::now();
+        for (unsigned c = 0; c < connectionCount; c++) {
+            workers.emplace_back([&, c] {
+                int fd = CrmServer::connectTo(address);
+                if (fd < 0) {
+                    results[c].failed = true;
+                    return;
+                }
+                drive(fd, count, [&](size_t i) { return request(c, i); }, results[c]);
+                ::close(fd);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+        vector<double> all;
+        size_t errors = 0;
+        for (const auto& result : results) {
+            if (result.failed) {
+                cout << "Error: lost connection to " << address << ".\n";
+                return false;
+            }
+            all.insert(all.end(), result.latencies.begin(), result.latencies.end());
+            errors += result.errors;
+        }
+        sort(all.begin(), all.end());
+        auto percentile = [&](double p) { return all.empty() ? 0.0 : all[min(all.size() - 1, static_cast<size_t>(p * all.size()))]; };
+        stringstream stats;
+        stats << fixed << setprecision(0) << name << ": " << all.size() << " requests in " << setprecision(2) << seconds
+              << " s: " << setprecision(0) << all.size() / seconds << " req/s, p50 " << percentile(0.50) << " us, p99 "
+              << percentile(0.99) << " us, p99.9 " << percentile(0.999) << " us, " << errors << " errors\n";
+        cout << stats.str();
+        return true;
+    };
+
+    auto clientId = [&](unsigned c, size_t i) { return "LG" + tag + "-" + to_string(c) + "-" + to_string(i); };
+
+    cout << "Load test against " << address << ": " << connectionCount << " connection(s), pipeline " << pipeline << "\n";
+    bool ok = runPhase("add", CLIENTS_PER_CONNECTION, [&](unsigned c, size_t i) {
+        return "add," + clientId(c, i) + ",Load,Gen" + to_string(i % 100) + "," + clientId(c, i) + "@load.test," +
+               to_string(-1 - run * 100000 - static_cast<int>(c * CLIENTS_PER_CONNECTION + i)) + ",LoadCo" + to_string(i % 50) + "\n";
+    });
+    ok = ok && runPhase("mixed", requestsPerConnection, [&](unsigned c, size_t i) {
+        size_t target = (i * 7919 + c * 104729) % CLIENTS_PER_CONNECTION;
+        switch (i % 10) {
+            case 8: return "search,Gen" + to_string(target % 100) + "\n";
+            case 9: return "contract," + clientId(c, target) + ",Load test,100.00,Pending\n";
+            default: return "get," + clientId(c, target) + "\n";
+        }
+    });
+    return ok ? 0 : 1;
+}
+
+// Check for the parallel CSV load (--check-parallel-load). Generates a
+// dataset with DatasetGenerator, mixes in damaged and awkward rows (bad
+// policy numbers and contract values, unknown interaction types, short and
+// blank rows, repeated IDs and emails, quoted fields spanning lines), then
+// loads it with one thread and with threads. The saved CSV and everything
+// the loads printed, bar the timing line, have to match byte for byte.
+int runParallelLoadCheck(DatasetGenerator::Spec spec, unsigned threads, const string& directory) {
+    const size_t DAMAGE_EVERY = 997;
+    if (threads < 2) {
+        cout << "Error: the parallel load check needs at least 2 threads.\n";
+        return 1;
+    }
+    string generated = directory + "/check_load.generated.csv";
+    string csvFile = directory + "/check_load.csv";
+    if (!DatasetGenerator(spec).write(generated)) return 1;
+
+    auto readFile = [](const string& filename, string& text) {
+        ifstream file(filename, ios::binary);
+        stringstream content;
+        content << file.rdbuf();
+        text = content.str();
+        return static_cast<bool>(file);
+    };
+    string data;
+    if (!readFile(generated, data)) return 1;
+    ::unlink(generated.c_str());
+
+    size_t headerEnd = CsvReader::findRecordEnd(data.data(), 0, data.size());
+    string firstId = data.substr(headerEnd + 1, data.find(',', headerEnd + 1) - headerEnd - 1);
+    auto damaged = [&](size_t k) -> string {
+        string id = "X" + to_string(k);
+        string policy = to_string(900000000 + k);
+        switch (k % 9) {
+            case 0: return id + ",Bad,Policy," + id + "@check.test,P-12,Nowhere,,,,,,,\n";
+            case 1: return id + ",Bad,Value," + id + "@check.test," + policy + ",Nowhere,Contract,\"Broken, value\",,,,n/a,Pending\n";
+            case 2: return id + ",Bad,Type," + id + "@check.test," + policy + ",Nowhere,Meeting,Lunch,,,,,\n";
+            case 3: return id + ",Short\n";
+            case 4: return "\n";
+            case 5: return firstId + ",Other,Name,other@check.test,1,Elsewhere,Contract,Repeated ID,,,,10.00,Signed\n";
+            case 6: return id + ",Same,Email,same@check.test," + policy + ",Nowhere,,,,,,,\n";
+            case 7: return id + ",Bad,Time," + id + "@check.test," + policy + ",Nowhere,Appointment,\"Call, later\",Anna,next week,10am,,\n";
+            default: return id + ",\"Multi\nLine\",\"Quoted \"\"name\"\"\"," + id + "@check.test," + policy +
+                            ",\"Co,\nLtd\",Contract,\"Note\r\nover lines\",,,,5.00,Signed\n";
+        }
+    };
+    {
+        AtomicFileWriter writer;
+        if (!writer.open(csvFile)) {
+            cout << "Error: Could not open file for writing.\n";
+            return 1;
+        }
+        size_t pos = 0, records = 0, injected = 0;
+        while (pos < data.size()) {
+            size_t end = min(CsvReader::findRecordEnd(data.data(), pos, data.size()) + 1, data.size());
+            writer.raw(string_view(data.data() + pos, end - pos));
+            pos = end;
+            if (++records % DAMAGE_EVERY == 0) writer.raw(damaged(injected++));
+        }
+        if (!writer.commit()) {
+            cout << "Error: Could not write " << csvFile << ".\n";
+            return 1;
+        }
+    }
+    data.clear();
+    data.shrink_to_fit();
+
+    // Loads csvFile with the given threads and saves it again into text,
+    // followed by the rows the load set aside; output gets what that
+    // printed, without the timings.
+    string savedFile = directory + "/check_load.saved.csv";
+    string rejectsFile = directory + "/check_load.rejects.csv";
+    auto loadAndSave = [&](unsigned loadThreads, string& text, string& output) {
+        stringstream captured;
+        streambuf* saved = cout.rdbuf(captured.rdbuf());
+        ClientManager manager;
+        bool ok = FileManager::loadFromCSV(csvFile, manager, loadThreads) && FileManager::saveToCSV(savedFile, manager);
+        cout.rdbuf(saved);
+        string line;
+        while (getline(captured, line)) {
+            if (line.compare(0, 7, "Parsed ") != 0 && line.compare(0, 6, "Wrote ") != 0) output += line + "\n";
+        }
+        string rejects;
+        if (!ok || !readFile(savedFile, text) || !readFile(rejectsFile, rejects)) return false;
+        text += rejects;
+        ::unlink(rejectsFile.c_str());
+        return true;
+    };
+    string sequentialOutput, parallelOutput, sequentialSaved, parallelSaved;
+    bool loaded = loadAndSave(1, sequentialSaved, sequentialOutput) && loadAndSave(threads, parallelSaved, parallelOutput);
+    for (const string& file : {csvFile, savedFile}) ::unlink(file.c_str());
+    if (!loaded) {
+        cout << "Error: the parallel load check could not load or save its data.\n";
+        return 1;
+    }
+
+    auto firstDifference = [](const string& a, const string& b) {
+        return static_cast<size_t>(mismatch(a.begin(), a.begin() + static_cast<long>(min(a.size(), b.size())), b.begin()).first - a.begin());
+    };
+    bool same = true;
+    if (sequentialOutput != parallelOutput) {
+        size_t at = firstDifference(sequentialOutput, parallelOutput);
+        cout << "Mismatch: load messages differ at byte " << at << ":\n  1 thread: "
+             << sequentialOutput.substr(at, 80) << "\n  " << threads << " threads: " << parallelOutput.substr(at, 80) << "\n";
+        same = false;
+    }
+    if (sequentialSaved != parallelSaved) {
+        size_t at = firstDifference(sequentialSaved, parallelSaved);
+        cout << "Mismatch: saved data differs at byte " << at << " (" << sequentialSaved.size() << " vs "
+             << parallelSaved.size() << " bytes)\n";
+        same = false;
+    }
+    size_t messages = static_cast<size_t>(count(sequentialOutput.begin(), sequentialOutput.end(), '\n'));
+    cout << (same ? "OK" : "FAILED") << ": loads with 1 and " << threads << " threads, " << sequentialSaved.size()
+         << " bytes saved, " << messages << " message line(s)\n";
+    return same ? 0 : 1;
+}
+
+// Writes the saved data, as of the last save, to filename: packed if it
+// ends in .crz, CSV otherwise.
+int runExport(const string& filename, bool packedStorage, unsigned threads) {
+    SegmentStore segments("crm_data.segments");
+    bool toPacked = packed::isPackedFile(filename);
+    if (!packedStorage && !toPacked) return segments.exportTo(filename) ? 0 : 1;
+
+    ClientManager manager;
+    if (packedStorage ? !FileManager::loadPacked("crm_data.crz", manager, threads) : !segments.load(manager, threads)) {
+        cout << "Error: no saved data to export.\n";
+        return 1;
+    }
+    bool saved = toPacked ? FileManager::savePacked(filename, manager, threads) : FileManager::saveToCSV(filename, manager);
+    return saved ? 0 : 1;
+}
+
+// Benchmark suite (--benchmark). For each size it generates a dataset with
+// DatasetGenerator and times the core operations on it, printing one JSON
+// object per line (operation, items, seconds, items/s, heap allocations,
+// peak RSS) so results can be collected and compared between builds. Peak
+// RSS is per operation where the kernel allows resetting the high-water
+// mark, otherwise it is the process peak so far. The startup record
+// compares a cold start from the CSV with one from the snapshot.
+int runBenchmark(const vector<size_t>& sizes, DatasetGenerator::Spec spec, unsigned threads, const string& directory) {
+    const size_t SEARCH_QUERIES = 1000;
+    const size_t CALENDAR_QUERIES = 10000;
+
+    struct NullBuffer : streambuf {
+        int overflow(int c) override { return c; }
+    } nullBuffer;
+
+    auto peakRssKb = []() -> long {
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) return atol(line.c_str() + 6);
+        }
+        return -1;
+    };
+
+    size_t size = 0;
+    bool ok = true;
+    // Runs op with cout silenced and returns its time in seconds. op
+    // returns the number of items it processed; zero marks a failed
+    // operation.
+    auto measure = [&](const char* name, const function<size_t()>& op) {
+        {
+            ofstream reset("/proc/self/clear_refs");
+            reset << "5";
+        }
+        streambuf* saved = cout.rdbuf(&nullBuffer);
+        uint64_t allocations = Metrics::snapshot().allocations;
+        auto startTime = chrono::steady_clock::now();
+        size_t items = op();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+        allocations = Metrics::snapshot().allocations - allocations;
+        cout.rdbuf(saved);
+        cout.clear();
+        if (items == 0) ok = false;
+
+        stringstream record;
+        record << "{\"size\":" << size << ",\"op\":\"" << name << "\",\"items\":" << items << ",\"seconds\":"
+               << fixed << setprecision(6) << seconds << ",\"per_second\":" << setprecision(0)
+               << (seconds > 0 ? items / seconds : 0.0) << ",\"allocations\":" << allocations
+               << ",\"peak_rss_kb\":" << peakRssKb() << "}\n";
+        cout << record.str();
+        return seconds;
+    };
+
+    auto fileSize = [](const string& filename) -> double {
+        struct stat info;
+        return stat(filename.c_str(), &info) == 0 ? static_cast<double>(info.st_size) : 0.0;
+    };
+
+    // Drops filename from the page cache, so the next read of it is cold.
+    auto evict = [](const string& filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        ::fdatasync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    };
+
+    cout << "{\"benchmark\":\"crm\",\"compiler\":\"" << __VERSION__ << "\",\"threads\":" << threads
+         << ",\"seed\":" << spec.seed << ",\"interactions_per_client\":" << spec.interactionsPerClient << "}\n";
+
+    for (size_t n : sizes) {
+        size = n;
+        spec.clients = n;
+        string base = directory + "/bench_" + to_string(n);
+        string csvFile = base + ".csv";
+        string savedFile = base + ".saved.csv";
+        string snapshotFile = base + ".snap";
+        string packedFile = base + ".crz";
+        double csvLoad = 0, csvSave = 0, packedLoad = 0, packedSave = 0;
+
+        DatasetGenerator generator(spec);
+        measure("generate", [&] { return generator.write(csvFile) ? generator.getRows() : 0; });
+        {
+            ClientManager manager;
+            csvLoad = measure("loadFromCSV", [&] {
+                return FileManager::loadFromCSV(csvFile, manager, threads) ? generator.getRows() : 0;
+            });
+            csvSave = measure("saveToCSV", [&] {
+                return FileManager::saveToCSV(savedFile, manager) ? generator.getRows() : 0;
+            });
+            measure("saveSnapshot", [&] {
+                return FileManager::saveSnapshot(snapshotFile, manager, true) ? manager.clientCount() : 0;
+            });
+            packedSave = measure("savePacked", [&] {
+                return FileManager::savePacked(packedFile, manager, threads, true) ? generator.getRows() : 0;
+            });
+            measure("searchClients", [&] {
+                size_t found = 0;
+                for (size_t q = 0; q < SEARCH_QUERIES; q++) {
+                    string term;
+                    switch (q % 5) {
+                        case 0: case 1: term = DatasetGenerator::lastName(q * 7 % spec.lastNames); break;
+                        case 2: case 3: term = DatasetGenerator::firstName(q * 13 % spec.firstNames); break;
+                        default: term = "Qzx" + to_string(q); break;
+                    }
+                    found += manager.searchClients(term).size();
+                }
+                return found > 0 ? SEARCH_QUERIES : 0;
+            });
+            if (generator.getInteractionCount() > 0) measure("iterateInteractions", [&] {
+                const auto& clients = manager.getClients();
+                const InteractionStore& store = manager.getInteractionStore();
+                size_t visited = 0;
+                double value = 0;
+                int64_t minutes = 0;
+                for (size_t i = 0; i < clients.size(); i++) {
+                    if (!manager.isLive(static_cast<int>(i))) continue;
+                    for (const auto& ref : manager.getInteractions(static_cast<int>(i))) {
+                        if (ref.kind == InteractionKind::Contract) {
+                            value += store.contract(ref).getValue();
+                        } else {
+                            minutes += store.appointment(ref).getTime().getMinutes();
+                        }
+                        visited++;
+                    }
+                }
+                // Keeps the loop from being optimized away.
+                volatile double sink = value + static_cast<double>(minutes);
+                (void)sink;
+                return visited;
+            });
+            if (generator.getInteractionCount() > 0) {
+                // Day windows over all appointments alternating with week
+                // windows for one salesperson, then double-booking checks at
+                // generated slot times. items counts queries; the appointments
+                // they return are only summed to keep the calls.
+                const InteractionStore& store = manager.getInteractionStore();
+                int64_t firstDay = DatasetGenerator::firstAppointmentDay();
+                size_t found = 0;
+                measure("appointmentsBetween", [&] {
+                    for (size_t q = 0; q < CALENDAR_QUERIES; q++) {
+                        int64_t day = firstDay + static_cast<int64_t>(q * 37 % DatasetGenerator::APPOINTMENT_DAYS);
+                        AppointmentTime from = AppointmentTime::startOfDay(day);
+                        if (q % 2 == 0) {
+                            found += store.appointmentsBetween(from, AppointmentTime::startOfDay(day + 1)).size();
+                        } else {
+                            string salesPerson = DatasetGenerator::salesPersonName(q % spec.salesPeople);
+                            found += store.appointmentsBetween(salesPerson, from, AppointmentTime::startOfDay(day + 7)).size();
+                        }
+                    }
+                    return CALENDAR_QUERIES;
+                });
+                measure("conflicts", [&] {
+                    for (size_t q = 0; q < CALENDAR_QUERIES; q++) {
+                        int64_t day = firstDay + static_cast<int64_t>(q * 53 % DatasetGenerator::APPOINTMENT_DAYS);
+                        int64_t minutes = day * AppointmentTime::MINUTES_PER_DAY + 8 * 60 + static_cast<int64_t>(q % 20) * 30;
+                        string salesPerson = DatasetGenerator::salesPersonName(q % spec.salesPeople);
+                        found += store.conflicts(salesPerson, AppointmentTime(minutes)).size();
+                    }
+                    return CALENDAR_QUERIES;
+                });
+                volatile size_t sink = found;
+                (void)sink;
+            }
+            measure("deleteClient", [&] {
+                // Every tenth client, spread over the whole table.
+                size_t deleted = 0;
+                for (size_t i = 0; i < manager.getClients().size(); i += 10) {
+                    if (manager.deleteClient(static_cast<int>(i))) deleted++;
+                }
+                return deleted;
+            });
+        }
+        {
+            ClientManager manager;
+            measure("loadSnapshot", [&] {
+                return FileManager::loadSnapshot(snapshotFile, manager, true) ? manager.clientCount() : 0;
+            });
+        }
+        {
+            ClientManager manager;
+            packedLoad = measure("loadPacked", [&] {
+                return FileManager::loadPacked(packedFile, manager, threads, true) ? generator.getRows() : 0;
+            });
+        }
+
+        // Cold start as the UI does it: the file evicted from the page cache,
+        // then loaded with every index built before the first command.
+        auto startup = [&](const char* name, const string& filename, const function<bool(ClientManager&)>& load) {
+            evict(filename);
+            ClientManager manager;
+            manager.setEagerIndexes(true);
+            return measure(name, [&] { return load(manager) ? manager.clientCount() : 0; });
+        };
+        double csvStartup = startup("startupFromCSV", csvFile, [&](ClientManager& manager) {
+            return FileManager::loadFromCSV(csvFile, manager, threads);
+        });
+        double snapshotStartup = startup("startupFromSnapshot", snapshotFile, [&](ClientManager& manager) {
+            return FileManager::loadSnapshot(snapshotFile, manager);
+        });
+        {
+            stringstream record;
+            record << fixed << setprecision(6) << "{\"size\":" << size << ",\"op\":\"startup\",\"csv_seconds\":" << csvStartup
+                   << ",\"snapshot_seconds\":" << snapshotStartup << setprecision(2) << ",\"speedup\":"
+                   << (snapshotStartup > 0 ? csvStartup / snapshotStartup : 0.0) << "}\n";
+            cout << record.str();
+        }
+
+        // Throughput is in bytes of the equivalent CSV, so both formats are
+        // measured against the same amount of data.
+        double csvBytes = fileSize(savedFile), packedBytes = fileSize(packedFile);
+        auto megabytesPerSecond = [&](double seconds) { return seconds > 0 ? csvBytes / (1024.0 * 1024.0) / seconds : 0.0; };
+        stringstream record;
+        record << fixed << setprecision(0) << "{\"size\":" << size << ",\"op\":\"compression\",\"csv_bytes\":" << csvBytes
+               << ",\"packed_bytes\":" << packedBytes << setprecision(2) << ",\"ratio\":" << (packedBytes > 0 ? csvBytes / packedBytes : 0.0)
+               << ",\"csv_load_mb_per_second\":" << megabytesPerSecond(csvLoad)
+               << ",\"packed_load_mb_per_second\":" << megabytesPerSecond(packedLoad)
+               << ",\"csv_save_mb_per_second\":" << megabytesPerSecond(csvSave)
+               << ",\"packed_save_mb_per_second\":" << megabytesPerSecond(packedSave) << "}\n";
+        cout << record.str();
+        for (const string& file : {csvFile, savedFile, snapshotFile, packedFile}) ::unlink(file.c_str());
+    }
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    string batchFile;
+    string serveAddress;
+    string loadTestAddress;
+    unsigned connections = 4;
+    size_t requests = 100000;
+    unsigned pipeline = 16;
+    string generateFile;
+    string exportFile;
+    bool packedStorage = false;
+    int autosaveSeconds = 300;
+    bool benchmark = false;
+    vector<size_t> sizes = {10000, 100000, 1000000};
+    string benchDirectory = ".";
+    unsigned checkThreads = 0;
+    DatasetGenerator::Spec spec;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = max(1, atoi(argv[++i]));
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchFile = argv[++i];
+        } else if (arg == "--stress-test" && i + 1 < argc) {
+            return runStressTest(max(1, atoi(argv[++i])), 2.0);
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (arg == "--load-test" && i + 1 < argc) {
+            loadTestAddress = argv[++i];
+        } else if (arg == "--connections" && i + 1 < argc) {
+            connections = max(1, atoi(argv[++i]));
+        } else if (arg == "--requests" && i + 1 < argc) {
+            requests = static_cast<size_t>(max(1LL, atoll(argv[++i])));
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            pipeline = max(1, atoi(argv[++i]));
+        } else if (arg == "--generate" && i + 1 < argc) {
+            generateFile = argv[++i];
+        } else if (arg == "--export" && i + 1 < argc) {
+            exportFile = argv[++i];
+        } else if (arg == "--storage" && i + 1 < argc && (string(argv[i + 1]) == "segments" || string(argv[i + 1]) == "packed")) {
+            packedStorage = string(argv[++i]) == "packed";
+        } else if (arg == "--autosave" && i + 1 < argc) {
+            autosaveSeconds = max(0, atoi(argv[++i]));
+        } else if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg == "--check-parallel-load" && i + 1 < argc) {
+            checkThreads = static_cast<unsigned>(max(0, atoi(argv[++i])));
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            sizes.clear();
+            stringstream list(argv[++i]);
+            string item;
+            while (getline(list, item, ',')) sizes.push_back(static_cast<size_t>(max(1LL, atoll(item.c_str()))));
+        } else if (arg == "--bench-dir" && i + 1 < argc) {
+            benchDirectory = argv[++i];
+        } else if (arg == "--clients" && i + 1 < argc) {
+            spec.clients = static_cast<size_t>(max(0LL, atoll(argv[++i])));
+        } else if (arg == "--interactions" && i + 1 < argc) {
+            spec.interactionsPerClient = max(0.0, atof(argv[++i]));
+        } else if (arg == "--first-names" && i + 1 < argc) {
+            spec.firstNames = static_cast<size_t>(max(1LL, atoll(argv[++i])));
+        } else if (arg == "--last-names" && i + 1 < argc) {
+            spec.lastNames = static_cast<size_t>(max(1LL, atoll(argv[++i])));
+        } else if (arg == "--companies" && i + 1 < argc) {
+            spec.companies = static_cast<size_t>(max(1LL, atoll(argv[++i])));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            spec.seed = strtoull(argv[++i], nullptr, 10);
+        } else {
+            cout << "Usage: " << argv[0] << " [--threads N] [--storage segments|packed] [--autosave SECONDS] [--batch FILE|-]\n"
+                 << "       " << argv[0] << " --stress-test READERS\n"
+                 << "       " << argv[0] << " [--threads N] [--autosave SECONDS] --serve unix:PATH|tcp:PORT\n"
+                 << "       " << argv[0] << " --load-test unix:PATH|tcp:PORT [--connections N] [--requests N] [--pipeline N]\n"
+                 << "       " << argv[0] << " [--storage segments|packed] --export FILE|FILE.crz\n"
+                 << "       " << argv[0] << " --generate FILE [--clients N] [DATASET OPTIONS]\n"
+                 << "       " << argv[0] << " --benchmark [--sizes N,N,...] [--bench-dir DIR] [--threads N] [DATASET OPTIONS]\n"
+                 << "       " << argv[0] << " --check-parallel-load THREADS [--bench-dir DIR] [--clients N] [DATASET OPTIONS]\n"
+                 << "Dataset options: --interactions MEAN --first-names N --last-names N --companies N --seed N\n";
+            return 1;
+        }
+    }
+    if (!loadTestAddress.empty()) return runLoadTest(loadTestAddress, connections, requests, pipeline);
+    if (!exportFile.empty()) return runExport(exportFile, packedStorage, threads);
+    if (!generateFile.empty()) return DatasetGenerator(spec).write(generateFile) ? 0 : 1;
+    if (benchmark) return runBenchmark(sizes, spec, threads, benchDirectory);
+    if (checkThreads > 0) return runParallelLoadCheck(spec, checkThreads, benchDirectory);
+
+    ClientManager manager;
+    UserInterface ui(manager, threads, packedStorage, chrono::seconds(autosaveSeconds));
+
+    if (!batchFile.empty()) {
+        // No prompts to interleave with, so let cout buffer freely.
+        ios::sync_with_stdio(false);
+        return ui.runBatch(batchFile) ? 0 : 2;
+    }
+    if (!serveAddress.empty()) return ui.runServer(serveAddress) ? 0 : 1;
+
+    cout << "InsuraPro CRM\n";
+    cout << "=============\n";
+
+    return ui.run() ? 0 : 1;
+}